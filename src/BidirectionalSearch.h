@@ -0,0 +1,213 @@
+#ifndef KNIGHT_SWAP_BIDIRECTIONALSEARCH_H
+#define KNIGHT_SWAP_BIDIRECTIONALSEARCH_H
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include "InstanceInfo.h"
+#include "BoardState.h"
+#include "PositionGraph.h"
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Meet-in-the-middle breadth-first search
+ *
+ * One search goes forward from the initial position, the other one backward from all the goal positions.
+ * In each round the side with the smaller frontier is expanded by one layer and every new position is looked up
+ * in the positions visited by the other side. The round in which the sides meet gives an optimal solution,
+ * which is then rebuilt by walking the stored depths back to the initial position and down to a goal.
+ */
+class BidirectionalSearch {
+public:
+    /**
+     * If there are more goal positions than this, the backward search cannot be seeded
+     */
+    static constexpr size_t MAX_GOALS = 100000;
+
+    explicit BidirectionalSearch(const InstanceInfo & instanceInfo, const vector<vector<position>> & symmetries,
+                                 const BoardState & initState) :
+            graph(instanceInfo, symmetries, initState),
+            initKey(graph.key(initState.whites, initState.blacks)) {
+        forward.name = "forward";
+        backward.name = "backward";
+    }
+
+    /**
+     * Returns false if the search cannot be used for the instance (too many goal positions)
+     */
+    bool solve() {
+        vector<PositionGraph::Key> goals = graph.goals(MAX_GOALS);
+        if (goals.empty())
+            return false;
+
+        forward.depth[initKey] = 0;
+        forward.frontier.push_back(initKey);
+        // symmetric goals have the same key
+        for (const auto & goal : goals) {
+            if (backward.depth.emplace(goal, 0).second)
+                backward.frontier.push_back(goal);
+        }
+
+        // the initial position is a goal itself
+        if (backward.depth.count(initKey)) {
+            found = true;
+            return true;
+        }
+
+        while (!found && !forward.frontier.empty() && !backward.frontier.empty()) {
+            bool expandForward = forward.frontier.size() <= backward.frontier.size();
+            Side & side = expandForward ? forward : backward;
+            expandLayer(side, expandForward ? backward : forward, expandForward);
+            printMemoryUsage(side);
+        }
+
+        if (found)
+            rebuildSolution();
+        return true;
+    }
+
+    /**
+     * Whether a solution exists, it is stored in the solution member
+     */
+    bool found = false;
+    vector<pair<position,position>> solution;
+    /**
+     * Number of expanded positions of both sides
+     */
+    size_t nExpanded = 0;
+
+private:
+    /**
+     * One direction of the search - depths of all the visited positions and the last layer of them
+     */
+    struct Side {
+        const char * name;
+        unordered_map<PositionGraph::Key, int> depth;
+        vector<PositionGraph::Key> frontier;
+        int layer = 0;
+    };
+
+    const PositionGraph graph;
+    const PositionGraph::Key initKey;
+    Side forward, backward;
+
+    /**
+     * The edge where the sides met - the move from -> to leads from the forward position to the backward one
+     * Both positions are in the same frame (see PositionGraph), so they are not necessarily the stored keys.
+     */
+    PositionGraph::Key meetForward, meetBackward;
+    position meetFrom = 0, meetTo = 0;
+
+    void expandLayer(Side & side, const Side & other, bool isForward) {
+        vector<PositionGraph::Key> next;
+        int bestLength = -1;
+
+        for (const auto & key : side.frontier) {
+            nExpanded++;
+            int depth = side.layer;
+
+            auto visit = [&](const PositionGraph::Key & neighbour, position from, position to) {
+                auto met = other.depth.find(neighbour);
+                if (met != other.depth.end()) {
+                    int length = depth + 1 + met->second;
+                    if (bestLength < 0 || length < bestLength) {
+                        bestLength = length;
+                        meetForward = isForward ? key : graph.moved(key, to, from);
+                        meetBackward = isForward ? graph.moved(key, from, to) : key;
+                        meetFrom = from;
+                        meetTo = to;
+                    }
+                }
+
+                if (side.depth.emplace(neighbour, depth + 1).second)
+                    next.push_back(neighbour);
+            };
+
+            if (isForward)
+                graph.forEachSuccessor(key, visit);
+            else
+                graph.forEachPredecessor(key, visit);
+        }
+
+        side.frontier.swap(next);
+        side.layer++;
+
+        // every shorter solution would have been found in an earlier layer
+        if (bestLength >= 0) {
+            found = true;
+            cout << "[MASTER] bidirectional search met after " << bestLength << " moves" << endl;
+        }
+    }
+
+    /**
+     * Walks from the meeting edge back to the initial position and forward to a goal
+     */
+    void rebuildSolution() {
+        vector<pair<position,position>> moves;
+
+        // the forward part is walked backwards - through predecessors with the depth one smaller
+        PositionGraph::Key current = meetForward;
+        for (int depth = forward.depth.at(graph.canonical(current)); depth > 0; --depth) {
+            bool stepped = false;
+            PositionGraph::Key previous;
+            graph.forEachPredecessor(current, [&](const PositionGraph::Key & key, position from, position to) {
+                auto it = forward.depth.find(key);
+                if (!stepped && it != forward.depth.end() && it->second == depth - 1) {
+                    stepped = true;
+                    previous = graph.moved(current, to, from);
+                    moves.emplace_back(from, to);
+                }
+            });
+            current = previous;
+        }
+        PositionGraph::Key start = current;
+        solution.assign(moves.rbegin(), moves.rend());
+        solution.emplace_back(meetFrom, meetTo);
+
+        // the backward part - through successors closer to a goal
+        current = meetBackward;
+        for (int depth = backward.depth.at(graph.canonical(current)); depth > 0; --depth) {
+            bool stepped = false;
+            PositionGraph::Key next;
+            graph.forEachSuccessor(current, [&](const PositionGraph::Key & key, position from, position to) {
+                auto it = backward.depth.find(key);
+                if (!stepped && it != backward.depth.end() && it->second == depth - 1) {
+                    stepped = true;
+                    next = graph.moved(current, from, to);
+                    solution.emplace_back(from, to);
+                }
+            });
+            current = next;
+        }
+
+        graph.toInitialFrame(start, solution);
+    }
+
+    /**
+     * Approximate memory taken by the stored positions of one side
+     * A hash table node holds the key, the depth, the cached hash and a link, plus one bucket pointer per bucket.
+     * libstdc++ keeps strings of up to 15 characters inline, longer keys take a heap block.
+     */
+    size_t visitedBytes(const Side & side) const {
+        size_t node = sizeof(pair<const PositionGraph::Key, int>) + sizeof(size_t) + sizeof(void *);
+        return side.depth.size() * (node + keyHeapBytes()) + side.depth.bucket_count() * sizeof(void *);
+    }
+
+    size_t frontierBytes(const Side & side) const {
+        return side.frontier.capacity() * sizeof(PositionGraph::Key) + side.frontier.size() * keyHeapBytes();
+    }
+
+    size_t keyHeapBytes() const {
+        return graph.keySize() > 15 ? graph.keySize() + 1 : 0;
+    }
+
+    void printMemoryUsage(const Side & side) const {
+        cout << "[MASTER] " << side.name << " layer " << side.layer
+             << ": frontier " << side.frontier.size() << " positions (" << frontierBytes(side) / 1024 << " KiB)"
+             << ", visited " << side.depth.size() << " positions (" << visitedBytes(side) / 1024 << " KiB)" << endl;
+    }
+};
+
+#endif //KNIGHT_SWAP_BIDIRECTIONALSEARCH_H
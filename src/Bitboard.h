@@ -0,0 +1,95 @@
+#ifndef KNIGHT_SWAP_BITBOARD_H
+#define KNIGHT_SWAP_BITBOARD_H
+
+#include <cstdint>
+#include <vector>
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Set of squares of the game board stored as a bit mask
+ *
+ * The number of 64-bit words is chosen by the board size. Boards of up to INLINE_WORDS * 64 squares
+ * keep the words inline, so copying a bitboard is just copying a few words without any allocation.
+ */
+class Bitboard {
+public:
+    static constexpr int INLINE_WORDS = 4;
+
+    Bitboard() = default;
+
+    explicit Bitboard(int nBits) :
+            nBits(nBits),
+            nWords((nBits + 63) / 64) {
+        if (nWords > INLINE_WORDS)
+            heapWords.resize(nWords);
+    }
+
+    /**
+     * Number of squares the bitboard is able to hold
+     */
+    int size() const {
+        return nBits;
+    }
+
+    bool test(position pos) const {
+        return (words()[pos >> 6] >> (pos & 63)) & 1;
+    }
+
+    void set(position pos) {
+        words()[pos >> 6] |= 1ULL << (pos & 63);
+    }
+
+    void reset(position pos) {
+        words()[pos >> 6] &= ~(1ULL << (pos & 63));
+    }
+
+    /**
+     * Calls f for every square which is in this set, in increasing order
+     */
+    template<typename F>
+    void forEach(F f) const {
+        const uint64_t * w = words();
+        for (int i = 0; i < nWords; ++i)
+            forEachInWord(w[i], i, f);
+    }
+
+    /**
+     * Calls f for every square which is in this set and not in the other one, in increasing order
+     */
+    template<typename F>
+    void forEachNotIn(const Bitboard & other, F f) const {
+        const uint64_t * w = words();
+        const uint64_t * o = other.words();
+        for (int i = 0; i < nWords; ++i)
+            forEachInWord(w[i] & ~o[i], i, f);
+    }
+
+private:
+    int nBits = 0;
+    int nWords = 0;
+    uint64_t inlineWords[INLINE_WORDS] = {};
+    /**
+     * Used instead of inlineWords only when the board is too large for them
+     */
+    vector<uint64_t> heapWords;
+
+    uint64_t * words() {
+        return nWords <= INLINE_WORDS ? inlineWords : heapWords.data();
+    }
+
+    const uint64_t * words() const {
+        return nWords <= INLINE_WORDS ? inlineWords : heapWords.data();
+    }
+
+    template<typename F>
+    static void forEachInWord(uint64_t word, int wordIndex, F & f) {
+        while (word) {
+            f((position)(wordIndex * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+};
+
+#endif //KNIGHT_SWAP_BITBOARD_H
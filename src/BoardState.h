@@ -1,8 +1,13 @@
 #ifndef KNIGHT_SWAP_BOARDSTATE_H
 #define KNIGHT_SWAP_BOARDSTATE_H
 
+#include <array>
 #include <queue>
+#include <cstdint>
 #include "InstanceInfo.h"
+#include "Bitboard.h"
+#include "LowerBoundHeuristic.h"
+#include "WireFormat.h"
 
 using namespace std;
 
@@ -12,17 +17,30 @@ using namespace std;
 class BoardState {
 public:
     explicit BoardState(int whitesLeft, int blacksLeft,
-                        vector<position> whites, vector<position> blacks, vector<bool> boardOccupation,
-                        size_t lowerBound,
+                        vector<position> whites, vector<position> blacks, int nSquares,
+                        int lowerBoundWhites, int lowerBoundBlacks,
                         vector<pair<position,position>> solutionCandidate
                         ) :
         whitesLeft(whitesLeft),
         blacksLeft(blacksLeft),
         whites(std::move(whites)),
         blacks(std::move(blacks)),
-        boardOccupation(std::move(boardOccupation)),
-        lowerBound(lowerBound),
+        occupied(nSquares),
+        whitesMask(nSquares),
+        blacksMask(nSquares),
+        lowerBoundWhites(lowerBoundWhites),
+        lowerBoundBlacks(lowerBoundBlacks),
+        lowerBound(lowerBoundWhites + lowerBoundBlacks),
         solutionCandidate(std::move(solutionCandidate)) {
+
+        for (const auto& pos : this->whites) {
+            occupied.set(pos);
+            whitesMask.set(pos);
+        }
+        for (const auto& pos : this->blacks) {
+            occupied.set(pos);
+            blacksMask.set(pos);
+        }
     }
 
     BoardState(const BoardState & o) = default;
@@ -36,79 +54,193 @@ public:
      */
     vector<position> whites, blacks;
     /**
-     * For each position on the game board, it says whether it is occupied or not
+     * Squares occupied by any knight and by knights of given color
+     */
+    Bitboard occupied, whitesMask, blacksMask;
+    /**
+     * Lower bounds on the number of moves the knights of given color still need
+     */
+    int lowerBoundWhites, lowerBoundBlacks;
+    /**
+     * Lower bound on the number of moves still needed, the sum of both colors
      */
-    vector<bool> boardOccupation;
     size_t lowerBound;
     /**
      * Vector of pairs where the first item is a starting point and the second item is an ending point of given move
      */
     vector<pair<position,position>> solutionCandidate;
+    /**
+     * Zobrist hashes of the knight positions mapped by the symmetries of the instance (see TranspositionTable),
+     * maintained by the solver and not serialized
+     */
+    array<uint64_t, InstanceInfo::MAX_SYMMETRIES> hashes{};
+
+    /**
+     * The turn rule of the game - the whites move in the odd steps and the blacks in the even ones,
+     * a color with all its knights in the destination area lets the other one move every step
+     */
+    static bool whitesOnTurn(int step, int whitesLeft, int blacksLeft) {
+        return ((step % 2 == 1) && (whitesLeft > 0)) || (blacksLeft == 0);
+    }
+
+    bool whitesOnTurn(int step) const {
+        return whitesOnTurn(step, whitesLeft, blacksLeft);
+    }
+
+    /**
+     * Calls f(knightIndex, current, next, nextColorBound, nextLowerBound) for every move of the color on turn
+     * which can still lead to a solution shorter than given bound, without making the move
+     * All the searches generate the moves here, so they all follow the same rules.
+     * Returns the number of the moves cut off by the bound.
+     */
+    template<typename F>
+    size_t forEachMove(const InstanceInfo & instanceInfo, const LowerBoundHeuristic & lowerBoundHeuristic,
+                     int step, size_t bound, F f) const {
+        bool white = whitesOnTurn(step);
+        const vector<position> & knights = white ? whites : blacks;
+        LowerBoundHeuristic::MoveEvaluator evaluator(lowerBoundHeuristic, knights, white);
+        int otherColorBound = white ? lowerBoundBlacks : lowerBoundWhites;
+        size_t cutoffs = 0;
+
+        for (int i = 0; i < (int)knights.size(); ++i) {
+            position current = knights[i];
+
+            // only the free squares a knight can jump to
+            instanceInfo.jumpMasks[current].forEachNotIn(occupied, [&](position next) {
+                int nextColorBound = evaluator.boundAfterMove(i, next);
+                size_t nextLowerBound = otherColorBound + nextColorBound;
+                if (step + nextLowerBound + 1 >= bound) {
+                    cutoffs++;
+                    return;
+                }
+
+                f(i, current, next, nextColorBound, nextLowerBound);
+            });
+        }
+
+        return cutoffs;
+    }
 
-    vector<int> serialize() {
-        vector<int> buffer;
+    /**
+     * Sets the lower bound of given color and updates the total one
+     */
+    void setColorLowerBound(bool white, int bound) {
+        (white ? lowerBoundWhites : lowerBoundBlacks) = bound;
+        lowerBound = lowerBoundWhites + lowerBoundBlacks;
+    }
 
-        buffer.push_back(whitesLeft);
-        buffer.push_back(blacksLeft);
+    /**
+     * Moves the knight of given color and index to the next square and appends the move to the solution candidate
+     * The lower bound and the hash are left to the caller
+     */
+    void makeMove(const InstanceInfo & instanceInfo, bool white, int knightIndex, position next) {
+        vector<position> & knights = white ? whites : blacks;
+        Bitboard & knightsMask = white ? whitesMask : blacksMask;
+        int & knightsLeft = white ? whitesLeft : blacksLeft;
+        SquareType destination = white ? BLACK : WHITE;
+
+        position current = knights[knightIndex];
+        knights[knightIndex] = next;
+        knightsMask.reset(current);
+        knightsMask.set(next);
+        occupied.reset(current);
+        occupied.set(next);
+
+        if (instanceInfo.squareType[current] == destination)
+            knightsLeft++;
+        if (instanceInfo.squareType[next] == destination)
+            knightsLeft--;
+
+        solutionCandidate.emplace_back(current, next);
+    }
 
-        buffer.push_back((int)whites.size());
+    /**
+     * Takes back the last move of the solution candidate made by makeMove with the same color and index
+     */
+    void undoMove(const InstanceInfo & instanceInfo, bool white, int knightIndex) {
+        vector<position> & knights = white ? whites : blacks;
+        Bitboard & knightsMask = white ? whitesMask : blacksMask;
+        int & knightsLeft = white ? whitesLeft : blacksLeft;
+        SquareType destination = white ? BLACK : WHITE;
+
+        position previous = solutionCandidate.back().first;
+        position current = solutionCandidate.back().second;
+        solutionCandidate.pop_back();
+
+        knights[knightIndex] = previous;
+        knightsMask.reset(current);
+        knightsMask.set(previous);
+        occupied.reset(current);
+        occupied.set(previous);
+
+        if (instanceInfo.squareType[current] == destination)
+            knightsLeft++;
+        if (instanceInfo.squareType[previous] == destination)
+            knightsLeft--;
+    }
+
+    /**
+     * The occupancy is not written, it is rebuilt from the knight positions
+     */
+    void serialize(WireWriter & out) const {
+        out.putNumber(whitesLeft);
+        out.putNumber(blacksLeft);
+
+        out.putNumber(whites.size());
         for (const auto& pos : whites)
-            buffer.push_back(pos);
+            out.putSquare(pos);
 
-        buffer.push_back((int)blacks.size());
+        out.putNumber(blacks.size());
         for (const auto& pos : blacks)
-            buffer.push_back(pos);
+            out.putSquare(pos);
 
-        buffer.push_back((int)boardOccupation.size());
-        for (const bool bo : boardOccupation)
-            buffer.push_back(bo);
+        out.putNumber(lowerBoundWhites);
+        out.putNumber(lowerBoundBlacks);
 
-        buffer.push_back((int)lowerBound);
+        serializeMoves(out);
+    }
 
-        buffer.push_back((int)solutionCandidate.size());
+    /**
+     * Writes only the moves which lead to the state from the initial one (see BoardStateBuilder)
+     */
+    void serializeMoves(WireWriter & out) const {
+        out.putNumber(solutionCandidate.size());
         for (const auto& item : solutionCandidate) {
-            buffer.push_back(item.first);
-            buffer.push_back(item.second);
+            out.putSquare(item.first);
+            out.putSquare(item.second);
         }
-
-        return buffer;
     }
 
-    static BoardState deserialize(vector<int>& buffer) {
-        int bufferIndex = 0;
-
-        int whitesLeft = buffer[bufferIndex++];
-        int blacksLeft = buffer[bufferIndex++];
+    static vector<pair<position,position>> deserializeMoves(WireReader & in) {
+        vector<pair<position,position>> res(in.getNumber());
+        for (auto& item : res) {
+            item.first = in.getSquare();
+            item.second = in.getSquare();
+        }
+        return res;
+    }
 
-        vector<position> whites;
-        int size = buffer[bufferIndex++];
-        for (int i = 0; i < size; ++i)
-            whites.push_back(buffer[bufferIndex++]);
+    static BoardState deserialize(WireReader & in) {
+        int whitesLeft = (int)in.getNumber();
+        int blacksLeft = (int)in.getNumber();
 
-        vector<position> blacks;
-        size = buffer[bufferIndex++];
-        for (int i = 0; i < size; ++i)
-            blacks.push_back(buffer[bufferIndex++]);
+        vector<position> whites(in.getNumber());
+        for (auto& pos : whites)
+            pos = in.getSquare();
 
-        vector<bool> boardOccupation;
-        size = buffer[bufferIndex++];
-        for (int i = 0; i < size; ++i)
-            boardOccupation.push_back(buffer[bufferIndex++]);
+        vector<position> blacks(in.getNumber());
+        for (auto& pos : blacks)
+            pos = in.getSquare();
 
-        int lowerBound = buffer[bufferIndex++];
+        int lowerBoundWhites = (int)in.getNumber();
+        int lowerBoundBlacks = (int)in.getNumber();
 
-        vector<pair<position,position>> solutionCandidate;
-        size = buffer[bufferIndex++];
-        for (int i = 0; i < size; ++i) {
-            int first = buffer[bufferIndex++];
-            int second = buffer[bufferIndex++];
-            solutionCandidate.emplace_back(first, second);
-        }
+        vector<pair<position,position>> solutionCandidate = deserializeMoves(in);
 
         return BoardState(
                 whitesLeft, blacksLeft,
-                whites, blacks, boardOccupation,
-                lowerBound,
+                whites, blacks, in.nSquares,
+                lowerBoundWhites, lowerBoundBlacks,
                 solutionCandidate
         );
     }
@@ -1,9 +1,11 @@
 #ifndef KNIGHT_SWAP_BOARDSTATEBUILDER_H
 #define KNIGHT_SWAP_BOARDSTATEBUILDER_H
 
+#include <algorithm>
 #include <queue>
 #include "InstanceInfo.h"
 #include "BoardState.h"
+#include "LowerBoundHeuristic.h"
 
 /***
  * Current state of the game board in given step
@@ -13,14 +15,33 @@ public:
     BoardState build() {
         return BoardState(
                 whitesLeft, blacksLeft,
-                whites, blacks, boardOccupation,
-                lowerBound,
+                whites, blacks, instanceInfo.nSquares,
+                lowerBoundWhites, lowerBoundBlacks,
                 solutionCandidate
         );
     }
 
-    explicit BoardStateBuilder(const InstanceInfo & instanceInfo) :
+    /**
+     * The initial state with given moves replayed on it
+     * The lower bounds are calculated for the reached position at once.
+     */
+    BoardState build(const vector<pair<position,position>> & moves) {
+        BoardState res = build();
+        for (const auto & move : moves) {
+            bool white = res.whitesMask.test(move.first);
+            const vector<position> & knights = white ? res.whites : res.blacks;
+            int knightIndex = (int)(find(knights.begin(), knights.end(), move.first) - knights.begin());
+            res.makeMove(instanceInfo, white, knightIndex, move.second);
+        }
+
+        res.setColorLowerBound(true, lowerBoundHeuristic.colorBound(res.whites, true));
+        res.setColorLowerBound(false, lowerBoundHeuristic.colorBound(res.blacks, false));
+        return res;
+    }
+
+    explicit BoardStateBuilder(const InstanceInfo & instanceInfo, const LowerBoundHeuristic & lowerBoundHeuristic) :
             instanceInfo(instanceInfo),
+            lowerBoundHeuristic(lowerBoundHeuristic),
             whitesLeft(instanceInfo.nKnightsInParty),
             blacksLeft(instanceInfo.nKnightsInParty),
             solutionCandidate(vector<pair<position,position>>()) {
@@ -30,19 +51,17 @@ public:
             switch (type) {
                 case WHITE:
                     whites.emplace_back(pos);
-                    boardOccupation.emplace_back(true);
                     break;
                 case BLACK:
                     blacks.emplace_back(pos);
-                    boardOccupation.emplace_back(true);
                     break;
                 case BASIC:
-                    boardOccupation.emplace_back(false);
                     break;
             }
         }
 
-        lowerBound = getInitLowerBound();
+        lowerBoundWhites = lowerBoundHeuristic.colorBound(whites, true);
+        lowerBoundBlacks = lowerBoundHeuristic.colorBound(blacks, false);
     }
 
     /**
@@ -54,10 +73,9 @@ public:
      */
     vector<position> whites, blacks;
     /**
-     * For each position on the game board, it says whether it is occupied or not
+     * Lower bounds on the number of moves the knights of given color still need
      */
-    vector<bool> boardOccupation;
-    size_t lowerBound;
+    int lowerBoundWhites, lowerBoundBlacks;
     /**
      * Vector of pairs where the first item is a starting point and the second item is an ending point of given move
      */
@@ -66,18 +84,7 @@ public:
 private:
 
     const InstanceInfo & instanceInfo;
-
-    /**
-     * A sum of minimal distances to destination areas of all knights
-     */
-    int getInitLowerBound() {
-        int res = 0;
-        for (auto const & w : whites)
-            res += instanceInfo.minDistancesWhites.find(w)->second;
-        for (auto const & b : blacks)
-            res += instanceInfo.minDistancesBlacks.find(b)->second;
-        return res;
-    }
+    const LowerBoundHeuristic & lowerBoundHeuristic;
 };
 
 #endif //KNIGHT_SWAP_BOARDSTATEBUILDER_H
@@ -0,0 +1,371 @@
+#ifndef KNIGHT_SWAP_EXTERNALBFS_H
+#define KNIGHT_SWAP_EXTERNALBFS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+#include "InstanceInfo.h"
+#include "BoardState.h"
+#include "PositionGraph.h"
+#include "PackedPositions.h"
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Breadth-first search keeping the layers of positions in files instead of memory
+ *
+ * Every layer is a file of sorted packed keys (see PositionGraph) read back through a memory mapping.
+ * The threads expand the last layer into buffers of limited size; a full buffer is sorted and written
+ * as a run file. The runs are then merged by a streaming merge which drops the duplicates and the positions
+ * of the earlier layers, and the result becomes the next layer.
+ *
+ * The alternation of the colors makes the moves one-way, so a position can return after any even number
+ * of steps, not only two. As the parity of the step of a position is fixed, the merge filters against
+ * all the earlier layers of the same parity - each of them is read once per layer in the same pass.
+ */
+class ExternalBfs {
+public:
+    explicit ExternalBfs(const InstanceInfo & instanceInfo, const vector<vector<position>> & symmetries,
+                         const BoardState & initState, const string & directory, size_t memoryCapMb) :
+            graph(instanceInfo, symmetries, initState),
+            initKey(graph.key(initState.whites, initState.blacks)),
+            keySize(graph.keySize()),
+            parentDirectory(directory),
+            memoryCap(max(memoryCapMb * 1024 * 1024, (size_t)1024 * 1024)) {
+    }
+
+    ~ExternalBfs() {
+        for (const auto & file : layerFiles)
+            remove(file.c_str());
+        if (!directory.empty())
+            rmdir(directory.c_str());
+    }
+
+    /**
+     * Returns false if the files cannot be created, written or read back, the reason is in the error member
+     */
+    bool solve() {
+        string pattern = parentDirectory + "/knight_swap_XXXXXX";
+        vector<char> buffer(pattern.begin(), pattern.end());
+        buffer.push_back('\0');
+        if (mkdtemp(buffer.data()) == nullptr) {
+            error = "cannot create a directory in " + parentDirectory;
+            return false;
+        }
+        directory = buffer.data();
+
+        PackedPositions init(keySize);
+        init.push(initKey);
+        layerFiles.push_back(writeFile(init));
+        if (ioFailed) {
+            error = "cannot write the layer files in " + directory;
+            return false;
+        }
+
+        if (graph.isGoal(initKey)) {
+            found = true;
+            return true;
+        }
+
+        size_t layerSize = 1;
+        while (!found && layerSize > 0 && !ioFailed) {
+            layerSize = expandLayer();
+            cout << "[MASTER] external BFS layer " << layerFiles.size() - 1 << ": " << layerSize << " positions" << endl;
+        }
+
+        // a short or missing file would look like a small or empty layer, so the result cannot be trusted
+        if (found && !ioFailed)
+            rebuildSolution();
+        if (ioFailed) {
+            error = "cannot write or read the layer files in " + directory;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Whether a solution exists, it is stored in the solution member
+     */
+    bool found = false;
+    vector<pair<position,position>> solution;
+    /**
+     * Number of expanded positions
+     */
+    size_t nExpanded = 0;
+    /**
+     * Why solve returned false
+     */
+    string error;
+
+private:
+    /**
+     * Read-only memory mapping of a file of sorted packed keys
+     * An empty file is mapped as no keys, a file which cannot be opened or mapped is marked as failed.
+     */
+    class MappedPositions {
+    public:
+        explicit MappedPositions(const string & path, size_t keySize) :
+                keySize(keySize) {
+            fd = open(path.c_str(), O_RDONLY);
+            struct stat st{};
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                failed = true;
+                return;
+            }
+            if (st.st_size == 0)
+                return;
+
+            bytes = (size_t)st.st_size;
+            void * mapped = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                bytes = 0;
+                failed = true;
+                return;
+            }
+            data = (const char *)mapped;
+            madvise(mapped, bytes, MADV_SEQUENTIAL);
+        }
+
+        MappedPositions(const MappedPositions &) = delete;
+
+        ~MappedPositions() {
+            if (data != nullptr)
+                munmap((void *)data, bytes);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        size_t size() const {
+            return bytes / keySize;
+        }
+
+        bool failed = false;
+
+        const char * at(size_t i) const {
+            return data + i * keySize;
+        }
+
+        PositionGraph::Key key(size_t i) const {
+            return PositionGraph::Key(at(i), keySize);
+        }
+
+        bool contains(const PositionGraph::Key & key) const {
+            size_t lo = 0, hi = size();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                int cmp = memcmp(at(mid), key.data(), keySize);
+                if (cmp == 0)
+                    return true;
+                if (cmp < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return false;
+        }
+
+    private:
+        const size_t keySize;
+        int fd = -1;
+        const char * data = nullptr;
+        size_t bytes = 0;
+    };
+
+    const PositionGraph graph;
+    const PositionGraph::Key initKey;
+    const size_t keySize;
+    const string parentDirectory;
+    /**
+     * Memory for the buffers of all the threads together in bytes
+     */
+    const size_t memoryCap;
+    string directory;
+    vector<string> layerFiles;
+    atomic<size_t> nFiles{0};
+    PositionGraph::Key goalKey;
+    /**
+     * Set when a file cannot be written or read, the search then stops
+     */
+    atomic<bool> ioFailed{false};
+
+    /**
+     * Sorts the positions and writes them to a new file, returns its path
+     */
+    string writeFile(PackedPositions & positions) {
+        positions.sortUnique();
+
+        string path = directory + "/" + to_string(nFiles++) + ".bin";
+        ofstream out(path, ios::binary);
+        positions.writeTo(out);
+        if (!out)
+            ioFailed = true;
+        out.close();
+        if (!out)
+            ioFailed = true;
+        return path;
+    }
+
+    /**
+     * Creates the next layer from the last one, returns its size
+     */
+    size_t expandLayer() {
+        vector<string> runs;
+
+        {
+            MappedPositions current(layerFiles.back(), keySize);
+            if (current.failed)
+                ioFailed = true;
+            size_t bufferCap = max(memoryCap / omp_get_max_threads() / keySize, (size_t)1024);
+
+            #pragma omp parallel
+            {
+                PackedPositions buffer(keySize);
+
+                #pragma omp for schedule(dynamic, 64)
+                for (size_t i = 0; i < current.size(); ++i) {
+                    graph.forEachSuccessor(current.key(i), [&](const PositionGraph::Key & next, position, position) {
+                        buffer.push(next);
+                        if (buffer.size() >= bufferCap) {
+                            string run = writeFile(buffer);
+                            buffer.clear();
+                            #pragma omp critical
+                            runs.push_back(run);
+                        }
+                    });
+                }
+
+                if (!buffer.empty()) {
+                    string run = writeFile(buffer);
+                    #pragma omp critical
+                    runs.push_back(run);
+                }
+            }
+            nExpanded += current.size();
+        }
+
+        string next = directory + "/" + to_string(nFiles++) + ".bin";
+        size_t res = mergeRuns(runs, next);
+        for (const auto & run : runs)
+            remove(run.c_str());
+
+        layerFiles.push_back(next);
+        return res;
+    }
+
+    /**
+     * Streaming merge of the sorted runs into the next layer, without duplicates and without the positions
+     * of the earlier layers of the same parity; returns the number of positions written
+     */
+    size_t mergeRuns(const vector<string> & runPaths, const string & outPath) {
+        vector<unique_ptr<MappedPositions>> runs;
+        for (const auto & path : runPaths) {
+            runs.emplace_back(new MappedPositions(path, keySize));
+            if (runs.back()->failed)
+                ioFailed = true;
+        }
+
+        // the next layer has the parity of the last but one layer
+        vector<unique_ptr<MappedPositions>> filters;
+        vector<size_t> filterPos;
+        for (int d = (int)layerFiles.size() - 2; d >= 0; d -= 2) {
+            filters.emplace_back(new MappedPositions(layerFiles[d], keySize));
+            filterPos.push_back(0);
+            if (filters.back()->failed)
+                ioFailed = true;
+        }
+        if (ioFailed)
+            return 0;
+
+        auto greater = [&runs, this](const pair<size_t, size_t> & a, const pair<size_t, size_t> & b) {
+            return memcmp(runs[a.first]->at(a.second), runs[b.first]->at(b.second), keySize) > 0;
+        };
+        priority_queue<pair<size_t, size_t>, vector<pair<size_t, size_t>>, decltype(greater)> heads(greater);
+        for (size_t i = 0; i < runs.size(); ++i)
+            if (runs[i]->size() > 0)
+                heads.emplace(i, 0);
+
+        ofstream out(outPath, ios::binary);
+        PositionGraph::Key last;
+        size_t res = 0;
+
+        while (!heads.empty()) {
+            auto head = heads.top();
+            heads.pop();
+            if (head.second + 1 < runs[head.first]->size())
+                heads.emplace(head.first, head.second + 1);
+
+            PositionGraph::Key key = runs[head.first]->key(head.second);
+            if (key == last)
+                continue;
+            last = key;
+
+            // the keys come in increasing order, so every filter is read just once
+            bool visited = false;
+            for (size_t f = 0; f < filters.size() && !visited; ++f) {
+                while (filterPos[f] < filters[f]->size() && memcmp(filters[f]->at(filterPos[f]), key.data(), keySize) < 0)
+                    filterPos[f]++;
+                visited = filterPos[f] < filters[f]->size() && memcmp(filters[f]->at(filterPos[f]), key.data(), keySize) == 0;
+            }
+            if (visited)
+                continue;
+
+            out.write(key.data(), (streamsize)keySize);
+            if (!out) {
+                ioFailed = true;
+                return res;
+            }
+            res++;
+
+            if (!found && graph.isGoal(key)) {
+                found = true;
+                goalKey = key;
+            }
+        }
+
+        out.close();
+        if (!out)
+            ioFailed = true;
+        return res;
+    }
+
+    /**
+     * Walks from the goal through the layer files back to the initial position, as in LayeredBfs
+     */
+    void rebuildSolution() {
+        PositionGraph::Key current = goalKey;
+        for (int d = (int)layerFiles.size() - 1; d > 0; --d) {
+            MappedPositions layer(layerFiles[d - 1], keySize);
+            if (layer.failed) {
+                ioFailed = true;
+                return;
+            }
+            bool stepped = false;
+            PositionGraph::Key previous;
+            graph.forEachPredecessor(current, [&](const PositionGraph::Key & key, position from, position to) {
+                if (!stepped && layer.contains(key)) {
+                    stepped = true;
+                    previous = graph.moved(current, to, from);
+                    solution.emplace_back(from, to);
+                }
+            });
+            current = previous;
+        }
+        reverse(solution.begin(), solution.end());
+        graph.toInitialFrame(current, solution);
+    }
+};
+
+#endif //KNIGHT_SWAP_EXTERNALBFS_H
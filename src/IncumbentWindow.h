@@ -0,0 +1,75 @@
+#ifndef KNIGHT_SWAP_INCUMBENTWINDOW_H
+#define KNIGHT_SWAP_INCUMBENTWINDOW_H
+
+#include <climits>
+#include <mpi.h>
+
+using namespace std;
+
+/***
+ * Size of the best solution known to any rank kept in a one-sided MPI window on the master
+ *
+ * The slaves lower it by an atomic MPI_MIN and read it by an atomic no-op, neither of them needs the master
+ * to receive a message, so a new bound reaches the other slaves as soon as they read it.
+ * All the ranks hold a shared lock on the window for its whole lifetime, every operation is flushed at once.
+ *
+ * Creating and freeing the window are collective, so every rank creates it when the mode is enabled.
+ */
+class IncumbentWindow {
+public:
+    explicit IncumbentWindow(bool enabled) :
+            enabled(enabled) {
+        if (!enabled)
+            return;
+
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &base, &window);
+        // nobody reads it before the master resets it for the first task
+        if (rank == 0)
+            *base = INT_MAX;
+        MPI_Win_lock_all(0, window);
+    }
+
+    IncumbentWindow(const IncumbentWindow &) = delete;
+
+    ~IncumbentWindow() {
+        if (!enabled)
+            return;
+
+        MPI_Win_unlock_all(window);
+        MPI_Win_free(&window);
+    }
+
+    /**
+     * Lowers the bound to given size unless it is already at most that small
+     */
+    void publish(int size) {
+        int previous;
+        MPI_Fetch_and_op(&size, &previous, MPI_INT, 0, 0, MPI_MIN, window);
+        MPI_Win_flush(0, window);
+    }
+
+    int read() {
+        int res;
+        MPI_Fetch_and_op(nullptr, &res, MPI_INT, 0, 0, MPI_NO_OP, window);
+        MPI_Win_flush(0, window);
+        return res;
+    }
+
+    /**
+     * Sets the bound even if it is larger, used by the master when no slave is working (a new IDA* iteration)
+     */
+    void reset(int size) {
+        int previous;
+        MPI_Fetch_and_op(&size, &previous, MPI_INT, 0, 0, MPI_REPLACE, window);
+        MPI_Win_flush(0, window);
+    }
+
+private:
+    const bool enabled;
+    int * base = nullptr;
+    MPI_Win window = MPI_WIN_NULL;
+};
+
+#endif //KNIGHT_SWAP_INCUMBENTWINDOW_H
@@ -3,10 +3,11 @@
 
 #include <string>
 #include <vector>
-#include <map>
-#include <set>
-#include <queue>
+#include <cstdint>
+#include <functional>
 #include "InputData.h"
+#include "Bitboard.h"
+#include "WireFormat.h"
 #include "Types.h"
 
 using namespace std;
@@ -17,23 +18,61 @@ using namespace std;
  */
 class InstanceInfo {
 public:
-    explicit InstanceInfo(map<position,vector<position>> movesForPos,
+    explicit InstanceInfo(vector<int> moveOffsets, vector<position> moveTargets,
+                          const int nRows, const int nCols,
                           const int nSquares, const int nKnightsInParty,
                           vector<SquareType> squareType,
-                          map<position, int> minDistancesWhites, map<position, int> minDistancesBlacks) :
-            movesForPos(std::move(movesForPos)),
+                          vector<int> minDistancesWhites, vector<int> minDistancesBlacks) :
+            moveOffsets(std::move(moveOffsets)),
+            moveTargets(std::move(moveTargets)),
+            nRows(nRows),
+            nCols(nCols),
             nSquares(nSquares),
             nKnightsInParty(nKnightsInParty),
             squareType(std::move(squareType)),
             minDistancesWhites(std::move(minDistancesWhites)),
-            minDistancesBlacks(std::move(minDistancesBlacks))
+            minDistancesBlacks(std::move(minDistancesBlacks)),
+            jumpMasks(buildJumpMasks()),
+            squareColor(buildSquareColor()),
+            destinationSquaresWhites(findSquares(BLACK)),
+            destinationSquaresBlacks(findSquares(WHITE)),
+            destinationDistancesWhites(buildDestinationDistances(destinationSquaresWhites)),
+            destinationDistancesBlacks(buildDestinationDistances(destinationSquaresBlacks)),
+            symmetries(buildSymmetries())
     {
     }
 
     /**
-     * For each position on the game board, it says all the possible destinations a knight can goes to from that position
+     * Distance used for squares from which a knight cannot reach the other square at all
+     * Small enough to be summed over all the knights without an overflow
      */
-    const map<position,vector<position>> movesForPos;
+    static constexpr int UNREACHABLE = 1 << 20;
+
+    /**
+     * Size of the largest group of symmetries of a board - the reflections and rotations of a square
+     */
+    static constexpr int MAX_SYMMETRIES = 8;
+
+    /**
+     * Contiguous range of the destinations a knight can jump to from one square
+     */
+    struct MoveRange {
+        const position * first, * last;
+
+        const position * begin() const { return first; }
+        const position * end() const { return last; }
+    };
+
+    /**
+     * For each position on the game board, all the possible destinations a knight can go to from that position
+     * Stored in CSR layout - destinations of position pos are moveTargets[moveOffsets[pos]] .. moveTargets[moveOffsets[pos + 1] - 1]
+     */
+    const vector<int> moveOffsets;
+    const vector<position> moveTargets;
+    /**
+     * Dimensions of the game board, position = row * nCols + col
+     */
+    const int nRows, nCols;
     /**
      * Total amount of squares on the game board
      */
@@ -46,76 +85,136 @@ public:
     /**
      * For each position on the game board, it says the minimal distance to the destination area
      */
-    const map<position, int> minDistancesWhites, minDistancesBlacks;
-
-    vector<int> serialize() const {
-        vector<int> buffer;
+    const vector<int> minDistancesWhites, minDistancesBlacks;
+    /**
+     * For each position on the game board, the set of squares a knight can jump to from that position
+     * It is derived from the move tables, so it is not serialized
+     */
+    const vector<Bitboard> jumpMasks;
+    /**
+     * For each position on the game board, its color on a checkerboard (0 or 1)
+     * Every knight move changes it, it is derived from the dimensions, so it is not serialized
+     */
+    const vector<uint8_t> squareColor;
+    /**
+     * Squares of the destination area of given color
+     */
+    const vector<position> destinationSquaresWhites, destinationSquaresBlacks;
+    /**
+     * Distances from each destination square to every position, destinationDistances[j * nSquares + pos]
+     * is the number of moves a knight needs from pos to the j-th destination square
+     * They are derived from the move tables, so they are not serialized
+     */
+    const vector<int> destinationDistancesWhites, destinationDistancesBlacks;
+    /**
+     * Reflections and rotations of the board which keep the type of every square, the identity first
+     * symmetries[k][pos] is the square pos is mapped to by the k-th of them. The knights start on the squares
+     * of their areas, so these map the initial position onto itself and symmetric positions are equally far
+     * from a solution. They are derived from the dimensions and the square types, so they are not serialized
+     */
+    const vector<vector<position>> symmetries;
 
-        buffer.push_back(nSquares);
-        buffer.push_back(nKnightsInParty);
+    /**
+     * The symmetries used by the searches - only the identity if the reduction is switched off
+     */
+    vector<vector<position>> symmetryGroup(bool enabled) const {
+        return enabled ? symmetries : vector<vector<position>>(symmetries.begin(), symmetries.begin() + 1);
+    }
 
-        for (const auto& item : movesForPos) {
-            buffer.push_back(item.first); // position
-            buffer.push_back((int)item.second.size()); // number of moves on that position
+    MoveRange movesFrom(position pos) const {
+        return {moveTargets.data() + moveOffsets[pos], moveTargets.data() + moveOffsets[pos + 1]};
+    }
 
-            for (const auto& move : item.second)
-                buffer.push_back(move); // moves
-        }
+    /**
+     * Knight distances of all the positions from the nearest of given source squares (multi-source BFS)
+     */
+    vector<int> distancesFrom(const vector<position> & sources) const {
+        return distancesFrom(moveOffsets, moveTargets, sources);
+    }
 
-        for (const auto& st : squareType) {
-            buffer.push_back(st);
-        }
+    /**
+     * The same on move tables in CSR layout, so the distances can be calculated before the instance info is built
+     * The queue and the distances are flat arrays, every square is visited once - O(nSquares) for any number of sources.
+     */
+    static vector<int> distancesFrom(const vector<int> & moveOffsets, const vector<position> & moveTargets,
+                                     const vector<position> & sources) {
+        int nSquares = (int)moveOffsets.size() - 1;
+        vector<int> res(nSquares, UNREACHABLE);
+        vector<position> q;
+        q.reserve(nSquares);
 
-        for (const auto& item : minDistancesWhites) {
-            buffer.push_back(item.first);
-            buffer.push_back(item.second);
+        for (const auto& source : sources) {
+            res[source] = 0;
+            q.push_back(source);
         }
 
-        for (const auto& item : minDistancesBlacks) {
-            buffer.push_back(item.first);
-            buffer.push_back(item.second);
+        for (size_t head = 0; head < q.size(); ++head) {
+            position current = q[head];
+            for (int m = moveOffsets[current]; m < moveOffsets[current + 1]; ++m) {
+                position next = moveTargets[m];
+                if (res[next] == UNREACHABLE) {
+                    res[next] = res[current] + 1;
+                    q.push_back(next);
+                }
+            }
         }
 
-        return buffer;
+        return res;
     }
 
-    static InstanceInfo deserialize(vector<int>& buffer) {
-        int bufferIndex = 0;
+    void serialize(WireWriter & out) const {
+        out.putNumber(nRows);
+        out.putNumber(nCols);
+        out.putNumber(nKnightsInParty);
 
-        int nSquares = buffer[bufferIndex++];
-        int nKnightsInParty = buffer[bufferIndex++];
+        // nSquares + 1 offsets are written as the numbers of moves from every square
+        for (position pos = 0; pos < nSquares; ++pos)
+            out.putNumber(moveOffsets[pos + 1] - moveOffsets[pos]);
 
-        map<position,vector<position>> movesForPos;
-        for (int i = 0; i < nSquares; ++i) {
-            int pos = buffer[bufferIndex++];
-            int nMoves = buffer[bufferIndex++];
+        for (const auto& move : moveTargets)
+            out.putSquare(move);
 
-            vector<position> moves;
-            for (int j = 0; j < nMoves; ++j)
-                moves.push_back(buffer[bufferIndex++]);
+        for (const auto& st : squareType)
+            out.putNumber(st);
 
-            movesForPos[pos] = std::move(moves);
-        }
+        for (const auto& distance : minDistancesWhites)
+            out.putNumber(distance);
 
-        vector<SquareType> squareType;
-        for (int i = 0; i < nSquares; ++i) {
-            squareType.push_back(static_cast<SquareType>(buffer[bufferIndex++]));
-        }
+        for (const auto& distance : minDistancesBlacks)
+            out.putNumber(distance);
+    }
 
-        map<position, int> minDistancesWhites;
-        for (int i = 0; i < nSquares; ++i) {
-            int id = buffer[bufferIndex++];
-            minDistancesWhites[id] = buffer[bufferIndex++];
-        }
+    static InstanceInfo deserialize(WireReader & in) {
+        int nSquares = in.nSquares;
+        int nRows = (int)in.getNumber();
+        int nCols = (int)in.getNumber();
+        int nKnightsInParty = (int)in.getNumber();
 
-        map<position, int> minDistancesBlacks;
-        for (int i = 0; i < nSquares; ++i) {
-            int id = buffer[bufferIndex++];
-            minDistancesBlacks[id] = buffer[bufferIndex++];
-        }
+        vector<int> moveOffsets(nSquares + 1, 0);
+        for (position pos = 0; pos < nSquares; ++pos)
+            moveOffsets[pos + 1] = moveOffsets[pos] + (int)in.getNumber();
+
+        vector<position> moveTargets(moveOffsets[nSquares]);
+        for (auto& move : moveTargets)
+            move = in.getSquare();
+
+        vector<SquareType> squareType(nSquares);
+        for (auto& st : squareType)
+            st = static_cast<SquareType>(in.getNumber());
+
+        vector<int> minDistancesWhites(nSquares);
+        for (auto& distance : minDistancesWhites)
+            distance = (int)in.getNumber();
+
+        vector<int> minDistancesBlacks(nSquares);
+        for (auto& distance : minDistancesBlacks)
+            distance = (int)in.getNumber();
 
         return InstanceInfo(
-                movesForPos,
+                moveOffsets,
+                moveTargets,
+                nRows,
+                nCols,
                 nSquares,
                 nKnightsInParty,
                 squareType,
@@ -123,6 +222,76 @@ public:
                 minDistancesBlacks
         );
     }
+
+private:
+    vector<Bitboard> buildJumpMasks() const {
+        vector<Bitboard> res(nSquares, Bitboard(nSquares));
+
+        for (position pos = 0; pos < nSquares; ++pos)
+            for (const auto& move : movesFrom(pos))
+                res[pos].set(move);
+
+        return res;
+    }
+
+    vector<uint8_t> buildSquareColor() const {
+        vector<uint8_t> res(nSquares);
+        for (position pos = 0; pos < nSquares; ++pos)
+            res[pos] = (pos / nCols + pos % nCols) % 2;
+        return res;
+    }
+
+    vector<position> findSquares(SquareType type) const {
+        vector<position> res;
+        for (position pos = 0; pos < nSquares; ++pos)
+            if (squareType[pos] == type)
+                res.push_back(pos);
+        return res;
+    }
+
+    vector<int> buildDestinationDistances(const vector<position> & destinationSquares) const {
+        vector<int> res;
+        res.reserve(destinationSquares.size() * nSquares);
+
+        for (const auto& square : destinationSquares) {
+            vector<int> distances = distancesFrom({square});
+            res.insert(res.end(), distances.begin(), distances.end());
+        }
+
+        return res;
+    }
+
+    vector<vector<position>> buildSymmetries() const {
+        // maps of (row, col), the ones swapping rows and columns only on square boards
+        vector<function<pair<int,int>(int, int)>> candidates = {
+                [](int row, int col) { return make_pair(row, col); },
+                [this](int row, int col) { return make_pair(row, nCols - 1 - col); },
+                [this](int row, int col) { return make_pair(nRows - 1 - row, col); },
+                [this](int row, int col) { return make_pair(nRows - 1 - row, nCols - 1 - col); }
+        };
+        if (nRows == nCols) {
+            candidates.emplace_back([](int row, int col) { return make_pair(col, row); });
+            candidates.emplace_back([this](int row, int col) { return make_pair(nCols - 1 - col, nRows - 1 - row); });
+            candidates.emplace_back([this](int row, int col) { return make_pair(col, nRows - 1 - row); });
+            candidates.emplace_back([this](int row, int col) { return make_pair(nCols - 1 - col, row); });
+        }
+
+        // knight moves are kept by all of them, only the areas can break a symmetry
+        vector<vector<position>> res;
+        for (const auto & candidate : candidates) {
+            vector<position> image(nSquares);
+            bool keepsTypes = true;
+            for (position pos = 0; pos < nSquares && keepsTypes; ++pos) {
+                pair<int,int> mapped = candidate(pos / nCols, pos % nCols);
+                image[pos] = mapped.first * nCols + mapped.second;
+                keepsTypes = squareType[image[pos]] == squareType[pos];
+            }
+            if (keepsTypes)
+                res.push_back(image);
+        }
+
+        return res;
+    }
 };
 
 #endif //KNIGHT_SWAP_INSTANCEINFO_H
@@ -3,9 +3,6 @@
 
 #include <string>
 #include <vector>
-#include <map>
-#include <set>
-#include <queue>
 #include "InputData.h"
 #include "InstanceInfo.h"
 #include "Types.h"
@@ -19,7 +16,8 @@ class InstanceInfoBuilder {
 public:
     explicit InstanceInfoBuilder(const InputData & inputData) :
             inputData(inputData),
-            movesForPos(createMovesForPos()),
+            moveOffsets(createMoveOffsets()),
+            moveTargets(createMoveTargets()),
             nSquares(inputData.nCols * inputData.nRows),
             nKnightsInParty(inputData.nKnightsInParty),
             squareType(buildSquareType()),
@@ -30,7 +28,10 @@ public:
 
     InstanceInfo build() {
         return InstanceInfo(
-            movesForPos,
+            moveOffsets,
+            moveTargets,
+            inputData.nRows,
+            inputData.nCols,
             nSquares,
             nKnightsInParty,
             squareType,
@@ -43,9 +44,11 @@ private:
 
     const InputData & inputData;
     /**
-     * For each position on the game board, it says all the possible destinations a knight can goes to from that position
+     * For each position on the game board, all the possible destinations a knight can go to from that position
+     * in CSR layout (see InstanceInfo)
      */
-    map<position,vector<position>> movesForPos;
+    const vector<int> moveOffsets;
+    const vector<position> moveTargets;
     /**
      * Total amount of squares on the game board
      */
@@ -58,7 +61,7 @@ private:
     /**
      * For each position on the game board, it says the minimal distance to the destination area
      */
-    const map<position, int> minDistancesWhites, minDistancesBlacks;
+    const vector<int> minDistancesWhites, minDistancesBlacks;
 
     vector<SquareType> buildSquareType() const {
         vector<SquareType> res;
@@ -80,39 +83,16 @@ private:
         return res;
     }
 
-    map<position, int> calculateMinDistances(const SquareType & color) const {
-        map<position, int> res;
-
-        // For each position, find the shortest path to the destination area for given color using BFS
-        for (position pos = 0; pos < nSquares; ++pos) {
-            int shortest = 99999999;
-            set<position> visited;
-            visited.insert(pos);
-            queue<pair<position, int>> q; // first: position, second: number of steps traveled so far from that pos
-            q.emplace(pos, 0);
-
-            while (!q.empty()) {
-                position current = q.front().first;
-                int length = q.front().second;
-                q.pop();
-
-                if (squareType[current] == color) {
-                    shortest = length;
-                    break;
-                }
-
-                for (const position & next : movesForPos.find(current)->second) {
-                    if (visited.find(next) == visited.end()) {
-                        q.emplace(next, length + 1);
-                        visited.insert(next);
-                    }
-                }
-            }
-
-            res.insert({pos, shortest});
-        }
+    /**
+     * Distances of all the positions to the nearest square of given type - one BFS from all of them at once
+     */
+    vector<int> calculateMinDistances(const SquareType & color) const {
+        vector<position> sources;
+        for (position pos = 0; pos < nSquares; ++pos)
+            if (squareType[pos] == color)
+                sources.push_back(pos);
 
-        return res;
+        return InstanceInfo::distancesFrom(moveOffsets, moveTargets, sources);
     }
 
     /**
@@ -122,11 +102,12 @@ private:
         return row * inputData.nCols + col;
     }
 
-    map<position,vector<position>> createMovesForPos() const {
-        map<position,vector<position>> res;
-
+    /**
+     * All the possible destinations a knight can jump to from given square
+     */
+    vector<position> jumpDestinations(int row, int col) const {
         // all the possible pattern a knight can make
-        vector<pair<int,int>> patterns = {
+        static const vector<pair<int,int>> patterns = {
                 make_pair(-2,-1),
                 make_pair(-2, 1),
                 make_pair(-1, -2),
@@ -137,25 +118,41 @@ private:
                 make_pair(2, 1)
         };
 
-        for (int row = 0; row < inputData.nRows; ++row) {
-            for (int col = 0; col < inputData.nCols; ++col) {
-                vector<position> jumpDestinations;
-
-                for (const auto& pattern : patterns) {
-                    int rowNew = row + pattern.first;
-                    int colNew = col + pattern.second;
+        vector<position> res;
 
-                    if (colNew >= 0 && colNew < inputData.nCols && rowNew >= 0 && rowNew < inputData.nRows) {
-                        jumpDestinations.emplace_back(flatten(rowNew, colNew));
-                    }
-                }
+        for (const auto& pattern : patterns) {
+            int rowNew = row + pattern.first;
+            int colNew = col + pattern.second;
 
-                res.emplace(flatten(row, col), std::move(jumpDestinations));
+            if (colNew >= 0 && colNew < inputData.nCols && rowNew >= 0 && rowNew < inputData.nRows) {
+                res.emplace_back(flatten(rowNew, colNew));
             }
         }
 
         return res;
     }
+
+    vector<int> createMoveOffsets() const {
+        vector<int> res;
+        res.push_back(0);
+
+        for (int row = 0; row < inputData.nRows; ++row)
+            for (int col = 0; col < inputData.nCols; ++col)
+                res.push_back(res.back() + (int)jumpDestinations(row, col).size());
+
+        return res;
+    }
+
+    vector<position> createMoveTargets() const {
+        vector<position> res;
+
+        for (int row = 0; row < inputData.nRows; ++row)
+            for (int col = 0; col < inputData.nCols; ++col)
+                for (const auto& next : jumpDestinations(row, col))
+                    res.push_back(next);
+
+        return res;
+    }
 };
 
 #endif //KNIGHT_SWAP_INSTANCEINFOBUILDER_H
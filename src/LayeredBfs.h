@@ -0,0 +1,136 @@
+#ifndef KNIGHT_SWAP_LAYEREDBFS_H
+#define KNIGHT_SWAP_LAYEREDBFS_H
+
+#include <iostream>
+#include <vector>
+#include <omp.h>
+#include "InstanceInfo.h"
+#include "BoardState.h"
+#include "PositionGraph.h"
+#include "PackedPositions.h"
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Breadth-first search expanding whole layers of positions in parallel
+ *
+ * Layer d holds the positions first reached in step d as a sorted array of packed keys. Every thread expands
+ * a part of the layer into its own buffer, drops the positions found in the earlier layers and sorts the rest,
+ * the buffers are then merged into the next layer without duplicates.
+ * The parity of the step of a position is fixed (see PositionGraph), so only every other earlier layer
+ * can contain a new position. The first layer with a goal position gives an optimal solution,
+ * which is rebuilt through the stored layers.
+ */
+class LayeredBfs {
+public:
+    explicit LayeredBfs(const InstanceInfo & instanceInfo, const vector<vector<position>> & symmetries,
+                        const BoardState & initState) :
+            graph(instanceInfo, symmetries, initState),
+            initKey(graph.key(initState.whites, initState.blacks)) {
+    }
+
+    void solve() {
+        layers.emplace_back(graph.keySize());
+        layers.back().push(initKey);
+        if (graph.isGoal(initKey)) {
+            found = true;
+            return;
+        }
+
+        while (!found && !layers.back().empty()) {
+            expandLayer();
+
+            size_t bytes = 0;
+            for (const auto & layer : layers)
+                bytes += layer.bytes();
+            cout << "[MASTER] BFS layer " << layers.size() - 1 << ": " << layers.back().size() << " positions, "
+                 << bytes / 1024 << " KiB in all the layers" << endl;
+        }
+
+        if (found)
+            rebuildSolution();
+    }
+
+    /**
+     * Whether a solution exists, it is stored in the solution member
+     */
+    bool found = false;
+    vector<pair<position,position>> solution;
+    /**
+     * Number of expanded positions
+     */
+    size_t nExpanded = 0;
+
+private:
+    const PositionGraph graph;
+    const PositionGraph::Key initKey;
+    vector<PackedPositions> layers;
+    PositionGraph::Key goalKey;
+
+    /**
+     * Whether the position was reached in an earlier layer of the same parity as the next one
+     */
+    bool isVisited(const PositionGraph::Key & key) const {
+        for (int d = (int)layers.size() - 2; d >= 0; d -= 2)
+            if (layers[d].contains(key))
+                return true;
+        return false;
+    }
+
+    void expandLayer() {
+        const PackedPositions & current = layers.back();
+        vector<PackedPositions> parts(omp_get_max_threads(), PackedPositions(graph.keySize()));
+
+        #pragma omp parallel
+        {
+            PackedPositions & part = parts[omp_get_thread_num()];
+
+            #pragma omp for schedule(dynamic, 64)
+            for (size_t i = 0; i < current.size(); ++i) {
+                graph.forEachSuccessor(current.key(i), [&](const PositionGraph::Key & next, position, position) {
+                    if (!isVisited(next))
+                        part.push(next);
+                });
+            }
+
+            part.sortUnique();
+        }
+        nExpanded += current.size();
+
+        layers.push_back(PackedPositions::merge(parts, graph.keySize()));
+
+        // the first goal in the layer is as good as any other
+        const PackedPositions & next = layers.back();
+        for (size_t i = 0; i < next.size() && !found; ++i) {
+            if (graph.isGoal(next.key(i))) {
+                found = true;
+                goalKey = next.key(i);
+            }
+        }
+    }
+
+    /**
+     * Walks from the goal through the layers back to the initial position
+     * The moves are taken back on one position, so they all are in its frame (see PositionGraph).
+     */
+    void rebuildSolution() {
+        PositionGraph::Key current = goalKey;
+        for (int d = (int)layers.size() - 1; d > 0; --d) {
+            bool stepped = false;
+            PositionGraph::Key previous;
+            graph.forEachPredecessor(current, [&](const PositionGraph::Key & key, position from, position to) {
+                if (!stepped && layers[d - 1].contains(key)) {
+                    stepped = true;
+                    previous = graph.moved(current, to, from);
+                    solution.emplace_back(from, to);
+                }
+            });
+            current = previous;
+        }
+        reverse(solution.begin(), solution.end());
+        graph.toInitialFrame(current, solution);
+    }
+};
+
+#endif //KNIGHT_SWAP_LAYEREDBFS_H
@@ -0,0 +1,253 @@
+#ifndef KNIGHT_SWAP_LOWERBOUNDHEURISTIC_H
+#define KNIGHT_SWAP_LOWERBOUNDHEURISTIC_H
+
+#include <climits>
+#include <vector>
+#include "InstanceInfo.h"
+#include "SolverOptions.h"
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Lower bound on the number of moves the knights of one color still need to reach their destination area
+ *
+ * NEAREST sums the distances of the knights to the nearest destination square.
+ * ASSIGNMENT respects that only one knight can end on each destination square - it is the cost of a min-cost
+ * matching between the knights and the destination squares (Hungarian algorithm on the destination distances).
+ *
+ * With the parity refinement, the bound is rounded up to the parity the number of remaining moves must have.
+ * Every knight move changes the checkerboard color of one knight, so when the knights of a color have to fill
+ * their whole destination area, the parity of their remaining moves is fixed by the colors of the squares
+ * they stand on. Note that colors alternate only while both of them have work - once a color is done,
+ * the other one moves alone - so the alternation itself never forces more moves than the sum of both colors.
+ */
+class LowerBoundHeuristic {
+public:
+    explicit LowerBoundHeuristic(const InstanceInfo & instanceInfo, SolverOptions::Bound type, bool parityBound) :
+            instanceInfo(instanceInfo),
+            // a matching exists only if there are at least as many destination squares as knights
+            type(type == SolverOptions::ASSIGNMENT
+                 && instanceInfo.destinationSquaresWhites.size() >= (size_t)instanceInfo.nKnightsInParty
+                 && instanceInfo.destinationSquaresBlacks.size() >= (size_t)instanceInfo.nKnightsInParty
+                 ? SolverOptions::ASSIGNMENT : SolverOptions::NEAREST),
+            destinationColorsWhites(parityBound ? destinationColors(instanceInfo.destinationSquaresWhites) : -1),
+            destinationColorsBlacks(parityBound ? destinationColors(instanceInfo.destinationSquaresBlacks) : -1) {
+    }
+
+    /**
+     * Lower bound for the knights of given color standing on given positions (including the parity refinement)
+     */
+    int colorBound(const vector<position> & knights, bool white) const {
+        return MoveEvaluator(*this, knights, white).bound();
+    }
+
+    /**
+     * Evaluates the moves of single knights of one color from one board state
+     * The matching of the state is solved once, every move then only re-assigns the knight that moved.
+     */
+    class MoveEvaluator {
+    public:
+        explicit MoveEvaluator(const LowerBoundHeuristic & heuristic, const vector<position> & knights, bool white) :
+                heuristic(heuristic),
+                knights(knights),
+                minDistances(white ? heuristic.instanceInfo.minDistancesWhites : heuristic.instanceInfo.minDistancesBlacks),
+                destinationDistances(white ? heuristic.instanceInfo.destinationDistancesWhites : heuristic.instanceInfo.destinationDistancesBlacks),
+                n(white ? (int)heuristic.instanceInfo.destinationSquaresWhites.size() : (int)heuristic.instanceInfo.destinationSquaresBlacks.size()),
+                ws(workspace()) {
+
+            int colors = white ? heuristic.destinationColorsWhites : heuristic.destinationColorsBlacks;
+            if (colors >= 0) {
+                for (const auto& pos : knights)
+                    colors += heuristic.instanceInfo.squareColor[pos];
+                parity = colors % 2;
+            }
+
+            if (heuristic.type == SolverOptions::NEAREST) {
+                baseBound = 0;
+                for (const auto& pos : knights)
+                    baseBound += minDistances[pos];
+                return;
+            }
+
+            // rows are the knights padded by zero-cost rows up to the number of destination squares
+            ws.rows.assign(n, -1);
+            for (size_t i = 0; i < knights.size(); ++i)
+                ws.rows[i] = knights[i];
+
+            ws.u.assign(n + 1, 0);
+            ws.v.assign(n + 1, 0);
+            ws.p.assign(n + 1, 0);
+            for (int row = 1; row <= n; ++row)
+                addRow(row, ws.u, ws.v, ws.p);
+
+            baseBound = matchingCost(ws.p);
+        }
+
+        /**
+         * Bound of the color before any move
+         */
+        int bound() const {
+            return withParity(baseBound, parity);
+        }
+
+        /**
+         * Bound of the color after the knight with given index jumps to the next square
+         */
+        int boundAfterMove(int knightIndex, position next) {
+            // the move changes the parity of the remaining moves
+            return withParity(baseBound + delta(knightIndex, next), parity < 0 ? parity : parity ^ 1);
+        }
+
+    private:
+        /**
+         * Scratch arrays of the Hungarian algorithm, one set per thread so evaluating a node does not allocate
+         */
+        struct Workspace {
+            vector<int> u, v, p, u2, v2, p2, way, minv;
+            vector<char> used;
+            vector<position> rows;
+        };
+
+        const LowerBoundHeuristic & heuristic;
+        const vector<position> & knights;
+        const vector<int> & minDistances;
+        const vector<int> & destinationDistances;
+        const int n;
+        Workspace & ws;
+        /**
+         * Bound of the color before any move without the parity refinement
+         */
+        int baseBound;
+        /**
+         * Parity of the number of remaining moves of the color, -1 if it is not known
+         */
+        int parity = -1;
+
+        static int withParity(int bound, int parity) {
+            return parity < 0 || bound % 2 == parity ? bound : bound + 1;
+        }
+
+        /**
+         * Change of the bound of the color (without the parity refinement) after the knight with given index jumps
+         */
+        int delta(int knightIndex, position next) {
+            if (heuristic.type == SolverOptions::NEAREST)
+                return minDistances[next] - minDistances[knights[knightIndex]];
+
+            int row = knightIndex + 1;
+            ws.u2 = ws.u;
+            ws.v2 = ws.v;
+            ws.p2 = ws.p;
+            ws.rows[knightIndex] = next;
+
+            // free the column of the moved knight and make its potential feasible for the new costs
+            for (int col = 1; col <= n; ++col)
+                if (ws.p2[col] == row)
+                    ws.p2[col] = 0;
+            int minReduced = INT_MAX;
+            for (int col = 1; col <= n; ++col)
+                minReduced = min(minReduced, cost(row, col) - ws.v2[col]);
+            ws.u2[row] = minReduced;
+
+            // one augmenting path puts the knight back into the optimal matching
+            addRow(row, ws.u2, ws.v2, ws.p2);
+            int res = matchingCost(ws.p2) - baseBound;
+
+            ws.rows[knightIndex] = knights[knightIndex];
+            return res;
+        }
+
+        static Workspace & workspace() {
+            static thread_local Workspace res;
+            return res;
+        }
+
+        /**
+         * Cost of assigning the row (1-based) to the destination square col (1-based)
+         */
+        int cost(int row, int col) const {
+            position pos = ws.rows[row - 1];
+            return pos < 0 ? 0 : destinationDistances[(col - 1) * heuristic.instanceInfo.nSquares + pos];
+        }
+
+        int matchingCost(const vector<int> & p) const {
+            int res = 0;
+            for (int col = 1; col <= n; ++col)
+                res += cost(p[col], col);
+            return res;
+        }
+
+        /**
+         * Assigns one more row by a shortest augmenting path, keeping the potentials u, v feasible
+         * p[col] is the row assigned to the column, 0 if the column is free
+         */
+        void addRow(int row, vector<int> & u, vector<int> & v, vector<int> & p) {
+            ws.way.assign(n + 1, 0);
+            ws.minv.assign(n + 1, INT_MAX);
+            ws.used.assign(n + 1, false);
+
+            p[0] = row;
+            int col0 = 0;
+            do {
+                ws.used[col0] = true;
+                int row0 = p[col0], delta = INT_MAX, col1 = 0;
+
+                for (int col = 1; col <= n; ++col) {
+                    if (ws.used[col])
+                        continue;
+                    int reduced = cost(row0, col) - u[row0] - v[col];
+                    if (reduced < ws.minv[col]) {
+                        ws.minv[col] = reduced;
+                        ws.way[col] = col0;
+                    }
+                    if (ws.minv[col] < delta) {
+                        delta = ws.minv[col];
+                        col1 = col;
+                    }
+                }
+
+                for (int col = 0; col <= n; ++col) {
+                    if (ws.used[col]) {
+                        u[p[col]] += delta;
+                        v[col] -= delta;
+                    } else {
+                        ws.minv[col] -= delta;
+                    }
+                }
+
+                col0 = col1;
+            } while (p[col0] != 0);
+
+            // flip the augmenting path
+            do {
+                int col1 = ws.way[col0];
+                p[col0] = p[col1];
+                col0 = col1;
+            } while (col0 != 0);
+        }
+    };
+
+private:
+    const InstanceInfo & instanceInfo;
+    const SolverOptions::Bound type;
+    /**
+     * Number of dark destination squares of given color, -1 if the parity of the remaining moves is not known
+     */
+    const int destinationColorsWhites, destinationColorsBlacks;
+
+    /**
+     * The parity is known only if the knights fill the whole destination area
+     */
+    int destinationColors(const vector<position> & destinationSquares) const {
+        if (destinationSquares.size() != (size_t)instanceInfo.nKnightsInParty)
+            return -1;
+
+        int res = 0;
+        for (const auto& pos : destinationSquares)
+            res += instanceInfo.squareColor[pos];
+        return res;
+    }
+};
+
+#endif //KNIGHT_SWAP_LOWERBOUNDHEURISTIC_H
@@ -0,0 +1,145 @@
+#ifndef KNIGHT_SWAP_PACKEDPOSITIONS_H
+#define KNIGHT_SWAP_PACKEDPOSITIONS_H
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <queue>
+#include <vector>
+#include "PositionGraph.h"
+
+using namespace std;
+
+/***
+ * Set of positions stored as one flat array of fixed-size keys of the PositionGraph
+ *
+ * Positions are appended in any order, then sorted and deduplicated; a sorted set is searched by bisection.
+ * Without any per-position overhead it takes just the key size per position.
+ */
+class PackedPositions {
+public:
+    explicit PackedPositions(size_t keySize = 0) :
+            keySize(keySize) {
+    }
+
+    size_t size() const {
+        return keySize == 0 ? 0 : data.size() / keySize;
+    }
+
+    bool empty() const {
+        return data.empty();
+    }
+
+    /**
+     * Memory taken by the positions
+     */
+    size_t bytes() const {
+        return data.capacity();
+    }
+
+    const char * at(size_t i) const {
+        return data.data() + i * keySize;
+    }
+
+    PositionGraph::Key key(size_t i) const {
+        return PositionGraph::Key(at(i), keySize);
+    }
+
+    void push(const PositionGraph::Key & key) {
+        data.insert(data.end(), key.begin(), key.end());
+    }
+
+    void push(const char * key) {
+        data.insert(data.end(), key, key + keySize);
+    }
+
+    void clear() {
+        data.clear();
+    }
+
+    /**
+     * Writes the keys one after another, as they are stored
+     */
+    void writeTo(ostream & out) const {
+        out.write(data.data(), (streamsize)data.size());
+    }
+
+    /**
+     * Only for a sorted set
+     */
+    bool contains(const PositionGraph::Key & key) const {
+        size_t lo = 0, hi = size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int cmp = memcmp(at(mid), key.data(), keySize);
+            if (cmp == 0)
+                return true;
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    void sortUnique() {
+        vector<size_t> order(size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return memcmp(at(a), at(b), keySize) < 0;
+        });
+
+        vector<char> sorted;
+        sorted.reserve(data.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i > 0 && memcmp(at(order[i]), at(order[i - 1]), keySize) == 0)
+                continue;
+            sorted.insert(sorted.end(), at(order[i]), at(order[i]) + keySize);
+        }
+        sorted.shrink_to_fit();
+        data.swap(sorted);
+    }
+
+    /**
+     * Merges sorted sets into one sorted set without duplicates
+     */
+    static PackedPositions merge(const vector<PackedPositions> & parts, size_t keySize) {
+        PackedPositions res(keySize);
+        size_t total = 0;
+        for (const auto & part : parts)
+            total += part.data.size();
+        res.data.reserve(total);
+
+        // the smallest key of every part on the top, the part index breaks ties
+        auto greater = [&parts, keySize](const pair<size_t, size_t> & a, const pair<size_t, size_t> & b) {
+            int cmp = memcmp(parts[a.first].at(a.second), parts[b.first].at(b.second), keySize);
+            return cmp != 0 ? cmp > 0 : a.first > b.first;
+        };
+        priority_queue<pair<size_t, size_t>, vector<pair<size_t, size_t>>, decltype(greater)> heads(greater);
+        for (size_t i = 0; i < parts.size(); ++i)
+            if (!parts[i].empty())
+                heads.emplace(i, 0);
+
+        while (!heads.empty()) {
+            auto head = heads.top();
+            heads.pop();
+
+            const char * key = parts[head.first].at(head.second);
+            if (res.empty() || memcmp(res.at(res.size() - 1), key, keySize) != 0)
+                res.push(key);
+
+            if (head.second + 1 < parts[head.first].size())
+                heads.emplace(head.first, head.second + 1);
+        }
+
+        res.data.shrink_to_fit();
+        return res;
+    }
+
+private:
+    size_t keySize;
+    vector<char> data;
+};
+
+#endif //KNIGHT_SWAP_PACKEDPOSITIONS_H
@@ -0,0 +1,302 @@
+#ifndef KNIGHT_SWAP_POSITIONGRAPH_H
+#define KNIGHT_SWAP_POSITIONGRAPH_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "InstanceInfo.h"
+#include "BoardState.h"
+#include "Bitboard.h"
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Graph of the positions of the game for the searches which store whole layers of positions
+ *
+ * Knights of one color are interchangeable, so a position is just the set of squares of each color.
+ * It is packed into a string key - sorted squares of the whites followed by sorted squares of the blacks,
+ * one byte per square (two bytes on boards of more than 256 squares).
+ *
+ * Positions mapped onto each other by a symmetry of the instance (see InstanceInfo) are one node of the graph,
+ * its key is the smallest of the keys of the images. A key is a position as well, so the moves passed
+ * to the callbacks are in the frame of the given key; the solutions are rebuilt on such positions
+ * and finally mapped to the frame of the initial position.
+ *
+ * Every knight move changes the checkerboard color of the square of one knight, so the parity of the step
+ * in which a position is reached is the same on every path from the initial position. The color on turn
+ * is therefore given by the position itself and the graph does not need to know the step.
+ */
+class PositionGraph {
+public:
+    typedef string Key;
+
+    explicit PositionGraph(const InstanceInfo & instanceInfo, const vector<vector<position>> & symmetries,
+                           const BoardState & initState) :
+            instanceInfo(instanceInfo),
+            symmetries(symmetries),
+            bytesPerSquare(instanceInfo.nSquares <= 256 ? 1 : 2),
+            initColors(colors(initState.whites) + colors(initState.blacks)),
+            initPosition(pack(initState.whites, initState.blacks)) {
+    }
+
+    /**
+     * Number of bytes of every key
+     */
+    size_t keySize() const {
+        return 2 * instanceInfo.nKnightsInParty * bytesPerSquare;
+    }
+
+    /**
+     * Key of the position and of all the symmetric ones
+     */
+    Key key(const vector<position> & whites, const vector<position> & blacks) const {
+        Key res;
+        for (const auto & symmetry : symmetries) {
+            Key mapped = pack(image(symmetry, whites), image(symmetry, blacks));
+            if (res.empty() || mapped < res)
+                res = mapped;
+        }
+        return res;
+    }
+
+    Key canonical(const Key & key) const {
+        vector<position> whites, blacks;
+        decode(key, whites, blacks);
+        return this->key(whites, blacks);
+    }
+
+    /**
+     * The position reached from the given one by moving the knight from one square to another
+     * It is not mapped by the symmetries, so it stays in the frame of the given position.
+     */
+    Key moved(const Key & key, position from, position to) const {
+        vector<position> whites, blacks;
+        decode(key, whites, blacks);
+        for (auto * knights : {&whites, &blacks})
+            replace(knights->begin(), knights->end(), from, to);
+        return pack(whites, blacks);
+    }
+
+    /**
+     * Maps the moves made from the given start, a symmetric image of the initial position,
+     * to the moves made from the initial position itself
+     */
+    void toInitialFrame(const Key & start, vector<pair<position,position>> & moves) const {
+        vector<position> whites, blacks;
+        decode(initPosition, whites, blacks);
+
+        for (const auto & symmetry : symmetries) {
+            if (pack(image(symmetry, whites), image(symmetry, blacks)) != start)
+                continue;
+
+            vector<position> inverse(symmetry.size());
+            for (position pos = 0; pos < (position)symmetry.size(); ++pos)
+                inverse[symmetry[pos]] = pos;
+            for (auto & move : moves)
+                move = make_pair(inverse[move.first], inverse[move.second]);
+            return;
+        }
+    }
+
+    void decode(const Key & key, vector<position> & whites, vector<position> & blacks) const {
+        whites.resize(instanceInfo.nKnightsInParty);
+        blacks.resize(instanceInfo.nKnightsInParty);
+
+        size_t i = 0;
+        for (auto * knights : {&whites, &blacks}) {
+            for (auto & pos : *knights) {
+                pos = 0;
+                for (int b = 0; b < bytesPerSquare; ++b)
+                    pos = (pos << 8) | (unsigned char)key[i++];
+            }
+        }
+    }
+
+    /**
+     * Whether all the knights are in their destination areas
+     */
+    bool isGoal(const vector<position> & whites, const vector<position> & blacks) const {
+        return knightsLeft(whites, BLACK) + knightsLeft(blacks, WHITE) == 0;
+    }
+
+    bool isGoal(const Key & key) const {
+        vector<position> whites, blacks;
+        decode(key, whites, blacks);
+        return isGoal(whites, blacks);
+    }
+
+    /**
+     * The same rule as in the depth-first search, the parity of the step is given by the colors of the squares
+     */
+    bool areWhitesOnTurn(const vector<position> & whites, const vector<position> & blacks) const {
+        int stepParity = (colors(whites) + colors(blacks) + initColors) % 2;
+        return BoardState::whitesOnTurn(stepParity, knightsLeft(whites, BLACK), knightsLeft(blacks, WHITE));
+    }
+
+    /**
+     * Calls f(next, from, to) for every position reachable from the given one by one move
+     * The goal positions have no successors as the game ends there.
+     */
+    template<typename F>
+    void forEachSuccessor(const Key & key, F f) const {
+        vector<position> whites, blacks;
+        decode(key, whites, blacks);
+        if (isGoal(whites, blacks))
+            return;
+
+        bool white = areWhitesOnTurn(whites, blacks);
+        vector<position> & knights = white ? whites : blacks;
+        Bitboard occupied = occupancy(whites, blacks);
+
+        for (auto & knight : knights) {
+            position current = knight;
+            instanceInfo.jumpMasks[current].forEachNotIn(occupied, [&](position next) {
+                knight = next;
+                f(this->key(whites, blacks), current, next);
+            });
+            knight = current;
+        }
+    }
+
+    /**
+     * Calls f(previous, from, to) for every position from which the given one is reached by the move from -> to
+     * Knight moves are reversible, a move back is a predecessor if the moved color was on turn before it.
+     */
+    template<typename F>
+    void forEachPredecessor(const Key & key, F f) const {
+        vector<position> whites, blacks;
+        decode(key, whites, blacks);
+        Bitboard occupied = occupancy(whites, blacks);
+
+        for (bool white : {true, false}) {
+            vector<position> & knights = white ? whites : blacks;
+
+            for (auto & knight : knights) {
+                position current = knight;
+                instanceInfo.jumpMasks[current].forEachNotIn(occupied, [&](position previous) {
+                    knight = previous;
+                    if (!isGoal(whites, blacks) && areWhitesOnTurn(whites, blacks) == white)
+                        f(this->key(whites, blacks), previous, current);
+                });
+                knight = current;
+            }
+        }
+    }
+
+    /**
+     * All the positions with every knight in its destination area, empty if there are more than limit of them
+     */
+    vector<Key> goals(size_t limit) const {
+        vector<vector<position>> whites = combinations(instanceInfo.destinationSquaresWhites, limit);
+        vector<vector<position>> blacks = combinations(instanceInfo.destinationSquaresBlacks, limit);
+        if (whites.empty() || blacks.empty() || whites.size() * blacks.size() > limit)
+            return {};
+
+        vector<Key> res;
+        for (const auto & w : whites) {
+            for (const auto & b : blacks) {
+                if (!overlap(w, b))
+                    res.push_back(key(w, b));
+            }
+        }
+        return res;
+    }
+
+private:
+    const InstanceInfo & instanceInfo;
+    const vector<vector<position>> symmetries;
+    const int bytesPerSquare;
+    /**
+     * Number of dark squares occupied in the initial position
+     */
+    const int initColors;
+    /**
+     * Packed initial position itself, not mapped by the symmetries
+     */
+    const Key initPosition;
+
+    static vector<position> image(const vector<position> & symmetry, const vector<position> & knights) {
+        vector<position> res(knights.size());
+        for (size_t i = 0; i < knights.size(); ++i)
+            res[i] = symmetry[knights[i]];
+        return res;
+    }
+
+    Key pack(vector<position> whites, vector<position> blacks) const {
+        sort(whites.begin(), whites.end());
+        sort(blacks.begin(), blacks.end());
+
+        Key res;
+        res.reserve(keySize());
+        for (const auto * knights : {&whites, &blacks}) {
+            for (const auto & pos : *knights) {
+                if (bytesPerSquare == 2)
+                    res.push_back((char)(pos >> 8));
+                res.push_back((char)(pos & 0xff));
+            }
+        }
+        return res;
+    }
+
+    int colors(const vector<position> & knights) const {
+        int res = 0;
+        for (const auto & pos : knights)
+            res += instanceInfo.squareColor[pos];
+        return res;
+    }
+
+    int knightsLeft(const vector<position> & knights, SquareType destination) const {
+        int res = 0;
+        for (const auto & pos : knights)
+            if (instanceInfo.squareType[pos] != destination)
+                res++;
+        return res;
+    }
+
+    Bitboard occupancy(const vector<position> & whites, const vector<position> & blacks) const {
+        Bitboard res(instanceInfo.nSquares);
+        for (const auto & pos : whites)
+            res.set(pos);
+        for (const auto & pos : blacks)
+            res.set(pos);
+        return res;
+    }
+
+    static bool overlap(const vector<position> & a, const vector<position> & b) {
+        for (const auto & pos : a)
+            if (find(b.begin(), b.end(), pos) != b.end())
+                return true;
+        return false;
+    }
+
+    /**
+     * All the ways to place the knights of one color on given squares, empty if there are more than limit of them
+     */
+    vector<vector<position>> combinations(const vector<position> & squares, size_t limit) const {
+        vector<vector<position>> res;
+        vector<position> current;
+        if (!addCombinations(squares, 0, current, res, limit))
+            return {};
+        return res;
+    }
+
+    bool addCombinations(const vector<position> & squares, size_t from, vector<position> & current,
+                         vector<vector<position>> & res, size_t limit) const {
+        if (current.size() == (size_t)instanceInfo.nKnightsInParty) {
+            res.push_back(current);
+            return res.size() <= limit;
+        }
+
+        for (size_t i = from; i < squares.size(); ++i) {
+            current.push_back(squares[i]);
+            bool ok = addCombinations(squares, i + 1, current, res, limit);
+            current.pop_back();
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif //KNIGHT_SWAP_POSITIONGRAPH_H
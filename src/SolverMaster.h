@@ -3,12 +3,19 @@
 
 #include <algorithm>
 #include <iostream>
+#include <random>
+#include <set>
 #include <omp.h>
 #include <mpi.h>
-#include<chrono>
-#include<thread>
 #include "Types.h"
 #include "BoardState.h"
+#include "SolverOptions.h"
+#include "LowerBoundHeuristic.h"
+#include "IncumbentWindow.h"
+#include "BoardStateBuilder.h"
+#include "BidirectionalSearch.h"
+#include "LayeredBfs.h"
+#include "ExternalBfs.h"
 
 using namespace std;
 
@@ -17,10 +24,17 @@ using namespace std;
  */
 class SolverMaster {
 public:
-    explicit SolverMaster(const InputData & inputData, const InstanceInfo & instanceInfo, int nSlaves) :
+    explicit SolverMaster(const InputData & inputData, const InstanceInfo & instanceInfo, const SolverOptions & options,
+                          IncumbentWindow & incumbent, int nSlaves) :
         inputData(inputData),
         instanceInfo(instanceInfo),
-        nSlaves(nSlaves) {
+        options(options),
+        incumbent(incumbent),
+        lowerBoundHeuristic(instanceInfo, options.bound, options.parityBound),
+        symmetries(instanceInfo.symmetryGroup(options.symmetry)),
+        nSlaves(nSlaves),
+        nSubproblems(nSlaves + 1),
+        taskPrefixes(nSlaves + 1) {
     }
 
     /**
@@ -28,84 +42,145 @@ public:
      */
     void solve(BoardState & boardState, int step) {
         initLowerBound = boardState.lowerBound;
-        upperBound = getInitUpperBound(boardState);
+        cout << "[MASTER] positions are reduced by " << symmetries.size() << " symmetries of the board" << endl;
+
+        if (options.mode == SolverOptions::IDA_STAR) {
+            solveIdaStar(boardState, step);
+        } else if (options.mode == SolverOptions::BIDIRECTIONAL && solveBidirectional(boardState)) {
+            // solved by the master alone
+        } else if (options.mode == SolverOptions::LAYERED_BFS) {
+            solveLayeredBfs(boardState);
+        } else if (options.mode == SolverOptions::EXTERNAL_BFS && solveExternalBfs(boardState)) {
+            // solved by the master alone
+        } else {
+            upperBound = getInitUpperBound(boardState);
+
+            // the pre-solved solution is the first incumbent, the slaves search only for shorter ones
+            // its length is a real upper bound unlike the estimate, so it replaces the estimate even if it is larger
+            if (options.beamWidth > 0) {
+                vector<pair<position,position>> presolved = getBeamSolution(boardState, step);
+                if (!presolved.empty()) {
+                    solution = presolved;
+                    upperBound = presolved.size();
+                }
+            }
+
+            distributeWork(boardState, step, initLowerBound);
+
+            // the estimate was below the optimum - search again with a doubled bound until nothing is cut off
+            while (solution.empty() && nCutoffs > 0) {
+                upperBound *= 2;
+                nCutoffs = 0;
+                cout << "[MASTER] no solution within the estimate, upper bound raised to " << upperBound << endl;
+                distributeWork(boardState, step, initLowerBound);
+            }
+        }
 
-        set<int> slaves;
-        for (int i = 1; i <= nSlaves; ++i)
-            slaves.emplace(i);
+        // no more work to do - notify all the slaves
+        for (int slave = 1; slave <= nSlaves; ++slave) {
+            MPI_Request dummy_handle;
+            MPI_Isend(nullptr, 0, MPI_INT, slave, TAG::END, MPI_COMM_WORLD, &dummy_handle);
+        }
+
+        for (int slave = 1; slave <= nSlaves; ++slave)
+            cout << "[MASTER] slave " << slave << " solved " << nSubproblems[slave] << " subproblems" << endl;
+
+        cout << "[MASTER] end" << endl;
+    }
+
+    /**
+     * Splits the tree below given board state into tasks and lets the slaves solve them
+     *
+     * Returns when all the tasks are solved or when a solution of stopSize moves is found,
+     * the slaves stay alive waiting for another task or for the end.
+     * When there are no tasks left for an idle slave, a part of the task of a busy slave is stolen for it.
+     */
+    void distributeWork(BoardState & boardState, int step, size_t stopSize) {
+        busySlaves.clear();
+        idleSlaves.clear();
+        stealVictims.clear();
+        donatedStates = queue<pair<BoardState, int>>();
+
+        // no slave is working now, so the bound of the previous run can be replaced
+        if (options.boundWindow)
+            incumbent.reset((int)upperBound);
 
         // prepare init tasks which will be sent to the slaves to be processed
         queue<pair<BoardState, int>> initStates = getInitStates(boardState, step);
 
         // init work of the slaves by sending them the first task
-        for (const auto& slave : slaves) {
-            auto state = initStates.front();
-            initStates.pop();
-
-            vector<int> bufferBoardState = boardState.serialize();
-            MPI_Send(bufferBoardState.data(), (int)bufferBoardState.size(), MPI_INT, slave, TAG::BOARD_STATE, MPI_COMM_WORLD);
-
-            vector<int> buffer;
-            buffer.push_back(initLowerBound);
-            buffer.push_back(upperBound);
-            buffer.push_back(step);
-            MPI_Send(buffer.data(), (int)buffer.size(), MPI_INT, slave, TAG::BOARD_STATE_OTHERS, MPI_COMM_WORLD);
-        }
+        for (int slave = nSlaves; slave >= 1; --slave)
+            idleSlaves.push_back(slave);
+        assignWork(initStates, stopSize);
 
         cout << "[MASTER] init batch sent" << endl;
 
         vector<int> solutionSizeUpdateBuffer(1);
-        int bufferSize = 200 * 2;
+        double stopStart = -1;
+
+        // process the rest of the tasks, every steal request has to be answered before the slaves can get another work
+        // the master just waits for the next message, so it reacts to every message as soon as it arrives
+        while (!busySlaves.empty() || !stealVictims.empty()) {
+            // the solution cannot be improved - the busy slaves abandon their tasks instead of finishing them
+            if (stopStart < 0 && upperBound <= stopSize) {
+                stopStart = MPI_Wtime();
+                for (const auto& slave : busySlaves)
+                    MPI_Send(nullptr, 0, MPI_INT, slave, TAG::STOP, MPI_COMM_WORLD);
+                cout << "[MASTER] solution of size " << upperBound << " cannot be improved, stopping "
+                     << busySlaves.size() << " busy slaves" << endl;
+            }
 
-        // process the rest of the tasks
-        while (!slaves.empty()) {
-            std::vector<int> message(bufferSize);
             MPI_Status status;
-            int flag;
-
-            // probe for updates from slaves periodically
-            while (true) {
-                MPI_Iprobe(MPI_ANY_SOURCE, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &flag, &status);
-
-                // one of the slaves found a solution
-                if (flag) {
-                    MPI_Recv(message.data(), bufferSize, MPI_INT, MPI_ANY_SOURCE, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &status);
-
-                    // solution is better than the best one so far - update and notify other slaves
-                    if (message[0] < upperBound) {
-                        upperBound = message[0];
-                        solutionSizeUpdateBuffer[0] = (int)upperBound;
-                        cout << "[MASTER] upper bound updated to " << upperBound << endl;
-
-                        for (const auto& slave : slaves) {
-                            if (slave == status.MPI_SOURCE)
-                                continue;
-                            MPI_Request dummy_handle;
-                            MPI_Isend(solutionSizeUpdateBuffer.data(), (int)solutionSizeUpdateBuffer.size(), MPI_INT, slave, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &dummy_handle);
-                        }
+            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+
+            // one of the slaves found a solution
+            if (status.MPI_TAG == TAG::SOLUTION_SIZE_UPDATE) {
+                vector<int> message(1);
+                MPI_Recv(message.data(), 1, MPI_INT, status.MPI_SOURCE, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+                // solution is better than the best one so far - update and notify other slaves
+                if (message[0] < upperBound) {
+                    upperBound = message[0];
+                    solutionSizeUpdateBuffer[0] = (int)upperBound;
+                    cout << "[MASTER] upper bound updated to " << upperBound << endl;
+
+                    for (const auto& slave : busySlaves) {
+                        if (slave == status.MPI_SOURCE)
+                            continue;
+                        MPI_Request dummy_handle;
+                        MPI_Isend(solutionSizeUpdateBuffer.data(), (int)solutionSizeUpdateBuffer.size(), MPI_INT, slave, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &dummy_handle);
                     }
-
-                    message.clear();
-                }
-
-                MPI_Iprobe(MPI_ANY_SOURCE, TAG::SOLUTION, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
-
-                // one of the slaves finished his work
-                if (flag) {
-                    MPI_Recv(message.data(), bufferSize, MPI_INT, MPI_ANY_SOURCE, TAG::SOLUTION, MPI_COMM_WORLD, &status);
-                    break;
                 }
+                continue;
+            }
 
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // one of the slaves answered a steal request
+            if (status.MPI_TAG == TAG::WORK_DONATION) {
+                receiveDonation(status);
+                assignWork(initStates, stopSize);
+                stealWork(stopSize);
+                continue;
             }
 
+            // one of the slaves finished his work
+            int count;
+            MPI_Get_count(&status, MPI_INT, &count);
+            vector<int> message(count);
+            MPI_Recv(message.data(), count, MPI_INT, status.MPI_SOURCE, TAG::SOLUTION, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
             int bufferIndex = 0;
             int size = message[bufferIndex++];
 
+            // only the moves after the task prefix are sent in the delta mode
+            const vector<pair<position,position>> & prefix = taskPrefixes[status.MPI_SOURCE];
+            int nSent = size == 0 || !options.deltaTasks ? size : size - (int)prefix.size();
+
             // better solution found
             if (size != 0 && size <= upperBound) {
                 solution.clear();
-                for (int i = 0; i < size; ++i) {
+                if (options.deltaTasks)
+                    solution = prefix;
+                for (int i = 0; i < nSent; ++i) {
                     int first = message[bufferIndex++];
                     int second = message[bufferIndex++];
                     solution.emplace_back(first, second);
@@ -113,35 +188,97 @@ public:
 
                 upperBound = solution.size();
                 cout << "[MASTER] upper bound updated to " << upperBound << endl;
-
-                nIterations += message[bufferIndex++];
             }
 
-            // no more work to do - notify the slave who sent the solution
-            if (initStates.empty()) {
-                MPI_Request dummy_handle;
-                MPI_Isend(nullptr, 0, MPI_INT, status.MPI_SOURCE, TAG::END, MPI_COMM_WORLD, &dummy_handle);
-                slaves.erase(status.MPI_SOURCE);
-            // still soe work to do - give the slave who sent the solution another task
-            } else {
-                auto state = initStates.front();
-                initStates.pop();
+            // the node counts follow the solution moves
+            nIterations += message[1 + 2 * nSent];
+            nPruned += message[2 + 2 * nSent];
+            nCutoffs += message[3 + 2 * nSent];
 
-                if (initStates.empty())
-                    cout << "[MASTER] last init state pop" << endl;
+            // give the slave who sent the solution another task if there is some, otherwise steal some for it
+            busySlaves.erase(status.MPI_SOURCE);
+            idleSlaves.push_back(status.MPI_SOURCE);
+            assignWork(initStates, stopSize);
+            stealWork(stopSize);
+        }
 
-                vector<int> bufferBoardState = boardState.serialize();
-                MPI_Send(bufferBoardState.data(), (int)bufferBoardState.size(), MPI_INT, status.MPI_SOURCE, TAG::BOARD_STATE, MPI_COMM_WORLD);
+        if (stopStart >= 0)
+            cout << "[MASTER] slaves stopped in " << (MPI_Wtime() - stopStart) * 1000 << " ms" << endl;
+    }
 
-                vector<int> buffer;
-                buffer.push_back(initLowerBound);
-                buffer.push_back(upperBound);
-                buffer.push_back(step);
-                MPI_Send(buffer.data(), (int)buffer.size(), MPI_INT, status.MPI_SOURCE, TAG::BOARD_STATE_OTHERS, MPI_COMM_WORLD);
-            }
+    /**
+     * Iterative deepening on step + lower bound
+     *
+     * Each iteration is a branch-and-bound run of the slaves with the upper bound fixed just above the threshold,
+     * so the first solution found is provably optimal and stops the whole search.
+     * The threshold grows until a solution is found or until an iteration cuts off no node,
+     * then the whole tree was searched and there is no solution at all.
+     */
+    void solveIdaStar(BoardState & boardState, int step) {
+        // with a pre-solved solution only the shorter ones are searched for, it is used if there is none
+        vector<pair<position,position>> presolved;
+        if (options.beamWidth > 0)
+            presolved = getBeamSolution(boardState, step);
+        size_t maxThreshold = presolved.empty() ? SIZE_MAX : presolved.size() - 1;
+
+        for (size_t threshold = initLowerBound; threshold <= maxThreshold && solution.empty(); ++threshold) {
+            upperBound = threshold + 1;
+            size_t iterationsBefore = nIterations;
+            nCutoffs = 0;
+
+            distributeWork(boardState, step, threshold);
+
+            cout << "[MASTER] IDA* threshold " << threshold << ": " << nIterations - iterationsBefore << " nodes" << endl;
+            if (solution.empty() && nCutoffs == 0)
+                break;
         }
 
-        cout << "[MASTER] end" << endl;
+        if (solution.empty())
+            solution = presolved;
+    }
+
+    /**
+     * Meet-in-the-middle search of the master, the slaves stay idle
+     * Returns false if the search cannot be used for the instance.
+     */
+    bool solveBidirectional(const BoardState & boardState) {
+        BidirectionalSearch search(instanceInfo, symmetries, boardState);
+        if (!search.solve()) {
+            cout << "[MASTER] too many goal positions for the bidirectional search, using branch and bound" << endl;
+            return false;
+        }
+
+        solution = search.solution;
+        nIterations = search.nExpanded;
+        return true;
+    }
+
+    /**
+     * Breadth-first search by the threads of the master, the slaves stay idle
+     */
+    void solveLayeredBfs(const BoardState & boardState) {
+        LayeredBfs search(instanceInfo, symmetries, boardState);
+        search.solve();
+
+        solution = search.solution;
+        nIterations = search.nExpanded;
+    }
+
+    /**
+     * Breadth-first search by the threads of the master with the layers on disk, the slaves stay idle
+     * Returns false if the layer files cannot be created, written or read.
+     */
+    bool solveExternalBfs(const BoardState & boardState) {
+        ExternalBfs search(instanceInfo, symmetries, boardState,
+                           options.spillDirectory, options.memoryCapMb);
+        if (!search.solve()) {
+            cout << "[MASTER] external BFS failed: " << search.error << ", using branch and bound" << endl;
+            return false;
+        }
+
+        solution = search.solution;
+        nIterations = search.nExpanded;
+        return true;
     }
 
     /**
@@ -157,6 +294,10 @@ public:
 
         cout << "Solution length: " << solution.size() << endl;
         cout << "Found after " << nIterations << " iterations" << endl;
+        if (options.partialOrder)
+            cout << "Partial-order reduction skipped " << nPruned << " nodes" << endl;
+        if (presolveSeconds >= 0)
+            cout << "Beam search pre-solve took " << presolveSeconds * 1000 << " ms" << endl;
         int moveNum = 0;
 
         // get and print init board state
@@ -184,6 +325,17 @@ public:
 private:
     const InputData & inputData;
     const InstanceInfo & instanceInfo;
+    const SolverOptions & options;
+    /**
+     * Bound shared with the slaves when the window mode is enabled, it can be lower than upperBound
+     * while the solution of that size is still on the way from its slave
+     */
+    IncumbentWindow & incumbent;
+    const LowerBoundHeuristic lowerBoundHeuristic;
+    /**
+     * Symmetries of the instance used by the searches (see InstanceInfo)
+     */
+    const vector<vector<position>> symmetries;
     int nSlaves;
 
     /**
@@ -199,54 +351,299 @@ private:
     vector<pair<position,position>> solution;
 
     size_t nIterations = 0;
+    /**
+     * Child nodes skipped by the partial-order reduction of the slaves
+     */
+    size_t nPruned = 0;
+    /**
+     * Child nodes cut off by the upper bound, by the master and by the slaves
+     * None of them means the last search did not miss any solution, however long
+     */
+    size_t nCutoffs = 0;
+    /**
+     * Time spent by the beam search before the slaves started, negative if there was none
+     */
+    double presolveSeconds = -1;
+    /**
+     * Number of tasks sent to each slave (indexed by rank)
+     */
+    vector<size_t> nSubproblems;
+    /**
+     * Moves leading to the last task sent to each slave, the solutions of the delta mode are relative to them
+     */
+    vector<vector<pair<position,position>>> taskPrefixes;
+
+    /**
+     * Slaves working on a task and slaves waiting for one during distributeWork
+     */
+    set<int> busySlaves;
+    vector<int> idleSlaves;
+    /**
+     * Busy slaves asked to donate a part of their task which did not answer yet
+     */
+    set<int> stealVictims;
+    /**
+     * States split off the tasks of busy slaves (with their steps) waiting for an idle slave
+     */
+    queue<pair<BoardState, int>> donatedStates;
+    /**
+     * Picks the slaves to steal from - a random victim spreads the steals over the cluster
+     */
+    mt19937 stealGenerator{0x5741};
+
+    /**
+     * Sends a task to given slave
+     */
+    void sendTask(int slave, BoardState & state, int step, size_t stopSize) {
+        WireWriter out(instanceInfo.nSquares);
+        if (options.deltaTasks)
+            state.serializeMoves(out);
+        else
+            state.serialize(out);
+        out.send(slave, TAG::BOARD_STATE);
+        taskPrefixes[slave] = state.solutionCandidate;
+
+        vector<int> buffer;
+        buffer.push_back((int)stopSize);
+        buffer.push_back(options.boundWindow ? min((int)upperBound, incumbent.read()) : (int)upperBound);
+        buffer.push_back(step);
+        MPI_Send(buffer.data(), (int)buffer.size(), MPI_INT, slave, TAG::BOARD_STATE_OTHERS, MPI_COMM_WORLD);
+
+        nSubproblems[slave]++;
+    }
+
+    /**
+     * Gives a task to every idle slave as long as there are some, the donated states go first
+     */
+    void assignWork(queue<pair<BoardState, int>> & initStates, size_t stopSize) {
+        // the solution cannot be improved - the busy slaves just finish and the idle ones stay idle
+        if (upperBound <= stopSize)
+            return;
+
+        while (!idleSlaves.empty() && (!donatedStates.empty() || !initStates.empty())) {
+            int slave = idleSlaves.back();
+            idleSlaves.pop_back();
+
+            if (!donatedStates.empty()) {
+                sendTask(slave, donatedStates.front().first, donatedStates.front().second, stopSize);
+                donatedStates.pop();
+            } else {
+                auto state = initStates.front();
+                initStates.pop();
+
+                if (initStates.empty())
+                    cout << "[MASTER] last init state pop" << endl;
+
+                sendTask(slave, state.first, state.second, stopSize);
+            }
+
+            busySlaves.emplace(slave);
+        }
+    }
+
+    /**
+     * Asks randomly chosen busy slaves to split off a part of their task, one request for every idle slave
+     *
+     * A slave answers every request exactly once - with a state from the shallow end of its search
+     * or with an empty message when it has nothing to give (typically when it is just finishing).
+     */
+    void stealWork(size_t stopSize) {
+        if (upperBound <= stopSize)
+            return;
+
+        vector<int> candidates;
+        for (const auto& slave : busySlaves)
+            if (stealVictims.count(slave) == 0)
+                candidates.push_back(slave);
+
+        while (stealVictims.size() < idleSlaves.size() && !candidates.empty()) {
+            size_t i = uniform_int_distribution<size_t>(0, candidates.size() - 1)(stealGenerator);
+            int victim = candidates[i];
+            candidates[i] = candidates.back();
+            candidates.pop_back();
+
+            MPI_Send(nullptr, 0, MPI_INT, victim, TAG::WORK_REQUEST, MPI_COMM_WORLD);
+            stealVictims.emplace(victim);
+        }
+    }
+
+    /**
+     * Receives an answer to a steal request, the message is the step followed by the serialized state or empty
+     */
+    void receiveDonation(const MPI_Status & status) {
+        vector<uint8_t> message = WireReader::receive(status.MPI_SOURCE, TAG::WORK_DONATION);
+        stealVictims.erase(status.MPI_SOURCE);
+
+        // the slave had nothing to give
+        if (message.empty())
+            return;
+
+        WireReader in(std::move(message));
+        int donatedStep = (int)in.getNumber();
+        if (options.deltaTasks)
+            donatedStates.emplace(BoardStateBuilder(instanceInfo, lowerBoundHeuristic).build(BoardState::deserializeMoves(in)), donatedStep);
+        else
+            donatedStates.emplace(BoardState::deserialize(in), donatedStep);
+        cout << "[MASTER] state of step " << donatedStep << " donated by slave " << status.MPI_SOURCE << endl;
+    }
 
     /**
      * A sum of minimal distances to the most distant squares in destination areas of all knights
+     * The distances are looked up in the destination distance tables of the instance info.
      */
     int getInitUpperBound(BoardState & boardState) {
         int res = 0;
 
-        // For each position, find the shortest path to the most distant square in the destination area for given color using BFS
-        for (const auto& opt : {make_pair(boardState.whites, BLACK), make_pair(boardState.blacks, WHITE)}) {
-            for (const int& pos: opt.first) {
-                int mostDistantDestPathLen;
-                // first: position
-                // second.first: number of steps traveled so far from that pos
-                // second.second: number of destination squares visited
-                queue<pair<position, pair<int, int>>> q;
-                q.emplace(pos, make_pair(0, 0));
-
-                while (true) {
-                    position current = q.front().first;
-                    int length = q.front().second.first;
-                    int destVisited = q.front().second.second;
-                    q.pop();
-
-                    if (instanceInfo.squareType[current] == opt.second) {
-                        destVisited++;
-                    }
-                    if (destVisited == instanceInfo.nKnightsInParty) {
-                        mostDistantDestPathLen = length;
-                        break;
-                    }
-
-                    for (const position &next: instanceInfo.movesForPos.find(current)->second) {
-                        q.emplace(next, make_pair(length + 1, destVisited));
+        for (bool white : {true, false}) {
+            const vector<position> & knights = white ? boardState.whites : boardState.blacks;
+            const vector<int> & distances = white ? instanceInfo.destinationDistancesWhites : instanceInfo.destinationDistancesBlacks;
+            size_t nDestinations = distances.size() / instanceInfo.nSquares;
+
+            for (const auto & pos : knights) {
+                // the destination squares the knight cannot reach at all do not count
+                int mostDistantDestPathLen = 0;
+                bool reachable = false;
+                for (size_t j = 0; j < nDestinations; ++j) {
+                    int distance = distances[j * instanceInfo.nSquares + pos];
+                    if (distance != InstanceInfo::UNREACHABLE) {
+                        mostDistantDestPathLen = max(mostDistantDestPathLen, distance);
+                        reachable = true;
                     }
                 }
 
-                res += mostDistantDestPathLen;
+                res += reachable ? mostDistantDestPathLen : InstanceInfo::UNREACHABLE;
             }
         }
 
         return res+1;
     }
 
+    /**
+     * Calls f(newBoardState) for every state reachable from given one by one move
+     * which can still lead to a solution shorter than given bound
+     * Returns the number of the children cut off by the bound.
+     */
+    template<typename F>
+    size_t forEachChild(const BoardState & state, int step, size_t bound, F f) const {
+        bool areWhitesOnTurn = state.whitesOnTurn(step);
+
+        return state.forEachMove(instanceInfo, lowerBoundHeuristic, step, bound, [&](int knightIndex, position, position next, int nextColorBound, size_t) {
+            BoardState newBoardState(state);
+            newBoardState.makeMove(instanceInfo, areWhitesOnTurn, knightIndex, next);
+            newBoardState.setColorLowerBound(areWhitesOnTurn, nextColorBound);
+            f(newBoardState);
+        });
+    }
+
+    /**
+     * Move from a state of the beam to a candidate state of the next step
+     */
+    struct BeamMove {
+        size_t parent;
+        int knightIndex;
+        position next;
+        int nextColorBound;
+        size_t nextLowerBound;
+    };
+
+    /**
+     * Pre-solve - a beam search from given state keeping only the beamWidth states of each step with the smallest
+     * lower bound. It is fast and usually finds a solution much shorter than the initial upper bound,
+     * which then prunes the branch and bound from the start.
+     *
+     * Only the moves are generated for the whole step; the keys are computed and the states are created just for
+     * the states kept in the beam. The states do not carry their solution candidates, every step keeps the parent
+     * and the move of each of its states instead and the solution is rebuilt from the goal.
+     * A position can come back only after an even number of steps (see PositionGraph), so the positions already
+     * kept in the beam are remembered per parity of the step.
+     *
+     * Returns the solution of the first goal reached, empty if the beam dies out or runs out of time before reaching one.
+     */
+    vector<pair<position,position>> getBeamSolution(const BoardState & initState, int initStep) {
+        double start = MPI_Wtime();
+        vector<pair<position,position>> res;
+        size_t nExpanded = 0;
+        bool timedOut = false;
+
+        vector<BoardState> beam{initState};
+        beam[0].solutionCandidate.clear();
+        vector<vector<pair<size_t, pair<position,position>>>> history;
+        set<vector<position>> seen[2];
+        seen[initStep % 2].insert(positionKey(initState, initStep));
+
+        long goal = -1;
+        for (int step = initStep; !beam.empty() && goal < 0; ++step) {
+            if (MPI_Wtime() - start > options.beamTimeMs / 1000.0) {
+                timedOut = true;
+                break;
+            }
+
+            vector<BeamMove> moves;
+            for (size_t parent = 0; parent < beam.size(); ++parent) {
+                nExpanded++;
+                // the initial upper bound is only an estimate, the beam looks for any solution
+                beam[parent].forEachMove(instanceInfo, lowerBoundHeuristic, step, SIZE_MAX,
+                                         [&](int knightIndex, position, position next, int nextColorBound, size_t nextLowerBound) {
+                    moves.push_back({parent, knightIndex, next, nextColorBound, nextLowerBound});
+                });
+            }
+            stable_sort(moves.begin(), moves.end(), [](const BeamMove & a, const BeamMove & b) {
+                return a.nextLowerBound < b.nextLowerBound;
+            });
+
+            vector<BoardState> next;
+            history.emplace_back();
+            for (size_t i = 0; i < moves.size() && next.size() < options.beamWidth && goal < 0; ++i) {
+                const BeamMove & move = moves[i];
+                const BoardState & parent = beam[move.parent];
+                bool areWhitesOnTurn = parent.whitesOnTurn(step);
+                position current = (areWhitesOnTurn ? parent.whites : parent.blacks)[move.knightIndex];
+                if (!seen[(step + 1) % 2].insert(movedPositionKey(parent, step, move.knightIndex, move.next)).second)
+                    continue;
+
+                next.push_back(parent);
+                BoardState & state = next.back();
+                state.makeMove(instanceInfo, areWhitesOnTurn, move.knightIndex, move.next);
+                state.setColorLowerBound(areWhitesOnTurn, move.nextColorBound);
+                state.solutionCandidate.clear();
+                history.back().emplace_back(move.parent, make_pair(current, move.next));
+
+                // all the states of one step are equally long, the first goal is as good as any other
+                if (state.whitesLeft + state.blacksLeft == 0)
+                    goal = (long)next.size() - 1;
+            }
+            beam.swap(next);
+        }
+
+        if (goal >= 0) {
+            size_t index = goal;
+            for (size_t d = history.size(); d-- > 0;) {
+                res.push_back(history[d][index].second);
+                index = history[d][index].first;
+            }
+            reverse(res.begin(), res.end());
+            res.insert(res.begin(), initState.solutionCandidate.begin(), initState.solutionCandidate.end());
+        }
+
+        presolveSeconds = MPI_Wtime() - start;
+        cout << "[MASTER] beam search of width " << options.beamWidth << " expanded " << nExpanded << " states in "
+             << presolveSeconds * 1000 << " ms, ";
+        if (!res.empty())
+            cout << "solution of " << res.size() << " moves found" << endl;
+        else if (timedOut)
+            cout << "stopped by the time limit" << endl;
+        else
+            cout << "no solution found" << endl;
+        return res;
+    }
+
     /**
      * From one initial state, gets many of them
      *
      * A modification of the solverInner method
      * without doing recursive calls and with storing and returning states using BFS
+     * There are enough states to keep all the threads of all the slaves busy, each position is there at most once
+     * and the states are ordered best-first by step + lower bound.
      *
      * TODO refactor this to avoid code duplication while preserving efficiency
      */
@@ -254,8 +651,13 @@ private:
         queue<pair<BoardState, int>> q; // board state and the corresponding step
         q.emplace(initState, initStep);
 
-        int minNumOfStates = omp_get_max_threads() * 3;
-        while (q.size() < minNumOfStates) {
+        // BFS reaches every position first in its smallest step, a later occurrence has nothing new below it
+        set<vector<position>> seen;
+        seen.insert(positionKey(initState, initStep));
+
+        // all the ranks run with the same number of threads
+        size_t minNumOfStates = (size_t)nSlaves * omp_get_max_threads();
+        while (!q.empty() && q.size() < minNumOfStates) {
             BoardState state = q.front().first;
             int step = q.front().second;
             q.pop();
@@ -268,57 +670,73 @@ private:
                 }
             }
 
-            /* prepare all viable next states */
-
-            bool areWhitesOnTurn = ((step % 2 == 1) && (state.whitesLeft > 0)) || (state.blacksLeft == 0);
-            const vector<position> & knights = areWhitesOnTurn ? state.whites : state.blacks;
-            const map<position, int> & knightDistances = areWhitesOnTurn ? instanceInfo.minDistancesWhites : instanceInfo.minDistancesBlacks;
-
-            for (int i = 0; i < knights.size(); ++i) {
-                position current = knights[i];
-
-                for (const position & next: instanceInfo.movesForPos.find(current)->second) {
-                    if (state.boardOccupation[next])
-                        continue;
+            /* push all viable next states to the result */
 
-                    size_t nextLowerBound = state.lowerBound - knightDistances.find(current)->second + knightDistances.find(next)->second;
-                    if (step + nextLowerBound + 1 >= upperBound) {
-                        continue;
-                    }
-
-                    /* prepare a new board state */
-
-                    BoardState newBoardState(state);
-
-                    if (areWhitesOnTurn) {
-                        newBoardState.whites[i] = next;
+            nCutoffs += forEachChild(state, step, upperBound, [&](BoardState & newBoardState) {
+                if (seen.insert(positionKey(newBoardState, step + 1)).second)
+                    q.emplace(newBoardState, step + 1);
+            });
+        }
 
-                        if (instanceInfo.squareType[current] == BLACK)
-                            newBoardState.whitesLeft++;
-                        if (instanceInfo.squareType[next] == BLACK)
-                            newBoardState.whitesLeft--;
-                    } else {
-                        newBoardState.blacks[i] = next;
+        // the most promising states first, so good solutions (and tight bounds) are found early
+        vector<pair<BoardState, int>> states;
+        for (; !q.empty(); q.pop())
+            states.push_back(q.front());
+        stable_sort(states.begin(), states.end(), [](const pair<BoardState, int> & a, const pair<BoardState, int> & b) {
+            return a.second + a.first.lowerBound < b.second + b.first.lowerBound;
+        });
+        for (const auto& state : states)
+            q.push(state);
 
-                        if (instanceInfo.squareType[current] == WHITE)
-                            newBoardState.blacksLeft++;
-                        if (instanceInfo.squareType[next] == WHITE)
-                            newBoardState.blacksLeft--;
-                    }
+        return q;
+    }
 
-                    newBoardState.boardOccupation[current] = false;
-                    newBoardState.boardOccupation[next] = true;
-                    newBoardState.lowerBound = nextLowerBound;
-                    newBoardState.solutionCandidate.emplace_back(current, next);
+    /**
+     * Identifies the position of given state - knights of one color are interchangeable, so their positions are sorted
+     * The color on turn is included as the same knight positions with the other color on turn is a different position.
+     * Symmetric positions are equally far from a solution, so they share the smallest of their keys.
+     */
+    vector<position> positionKey(const BoardState & state, int step) const {
+        return positionKey(state.whites, state.blacks, state.whitesOnTurn(step));
+    }
 
-                    /* push it to the result */
+    /**
+     * Key of the position reached from given state by the move of the knight of given index, without creating the state
+     */
+    vector<position> movedPositionKey(const BoardState & state, int step, int knightIndex, position next) const {
+        bool white = state.whitesOnTurn(step);
+        vector<position> knights = white ? state.whites : state.blacks;
+        SquareType destination = white ? BLACK : WHITE;
+
+        int left = white ? state.whitesLeft : state.blacksLeft;
+        if (instanceInfo.squareType[knights[knightIndex]] == destination)
+            left++;
+        if (instanceInfo.squareType[next] == destination)
+            left--;
+        knights[knightIndex] = next;
+
+        int whitesLeft = white ? left : state.whitesLeft;
+        int blacksLeft = white ? state.blacksLeft : left;
+        bool areWhitesOnTurn = BoardState::whitesOnTurn(step + 1, whitesLeft, blacksLeft);
+        return white ? positionKey(knights, state.blacks, areWhitesOnTurn) : positionKey(state.whites, knights, areWhitesOnTurn);
+    }
 
-                    q.emplace(newBoardState, step + 1);
-                }
-            }
+    vector<position> positionKey(const vector<position> & whites, const vector<position> & blacks, bool areWhitesOnTurn) const {
+        vector<position> res;
+        for (const auto & symmetry : symmetries) {
+            vector<position> key, mappedBlacks;
+            for (const auto & pos : whites)
+                key.push_back(symmetry[pos]);
+            for (const auto & pos : blacks)
+                mappedBlacks.push_back(symmetry[pos]);
+            sort(key.begin(), key.end());
+            sort(mappedBlacks.begin(), mappedBlacks.end());
+            key.insert(key.end(), mappedBlacks.begin(), mappedBlacks.end());
+            key.push_back(areWhitesOnTurn);
+            if (res.empty() || key < res)
+                res = key;
         }
-
-        return q;
+        return res;
     }
 
     /**
@@ -0,0 +1,260 @@
+#ifndef KNIGHT_SWAP_SOLVEROPTIONS_H
+#define KNIGHT_SWAP_SOLVEROPTIONS_H
+
+#include <string>
+#include <stdexcept>
+
+using namespace std;
+
+/***
+ * Run-time configuration of the solver parsed from the command line
+ * Every rank parses the same arguments, so the options do not need to be sent over MPI
+ */
+struct SolverOptions {
+    /**
+     * Search strategy driven by the master
+     */
+    enum Mode {
+        BRANCH_AND_BOUND,   // one depth-first branch-and-bound run tightened by the incumbent solutions
+        IDA_STAR,           // iterative deepening on step + lower bound, each iteration is a bounded run
+        BIDIRECTIONAL,      // meet-in-the-middle breadth-first search run by the master alone
+        LAYERED_BFS,        // breadth-first search of packed positions run by the threads of the master
+        EXTERNAL_BFS        // the same with the layers kept in files
+    };
+
+    /**
+     * Lower bound on the number of moves the knights of one color still need
+     */
+    enum Bound {
+        NEAREST,    // sum of the distances of the knights to the nearest destination square
+        ASSIGNMENT  // min-cost matching of the knights to the destination squares
+    };
+
+    /**
+     * How the slave search handles board states of the child nodes
+     */
+    enum Engine {
+        COPY,       // every child is a copy of its parent explored in its own task
+        IN_PLACE    // moves are made and taken back on one state, only task spawn points take a copy
+    };
+
+    /**
+     * Who distributes the tasks of a slave among its threads
+     */
+    enum Scheduler {
+        OPENMP_TASKS,   // OpenMP tasks
+        WORK_STEALING   // own pool of Chase-Lev deques - a worker runs its newest tasks and steals the oldest ones
+    };
+
+    explicit SolverOptions(int argc, char* argv[]) {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+
+            if (arg.rfind("--", 0) != 0) {
+                if (!inputPath.empty()) {
+                    error = "Only one input file path can be provided!";
+                    return;
+                }
+                inputPath = arg;
+                continue;
+            }
+
+            size_t eq = arg.find('=');
+            string key = arg.substr(2, eq == string::npos ? string::npos : eq - 2);
+            string value = eq == string::npos ? "" : arg.substr(eq + 1);
+
+            if (key == "tt-size") {
+                if (!parseNumber(value, ttSizeMb))
+                    return;
+            } else if (key == "spill-dir") {
+                spillDirectory = value;
+            } else if (key == "memory-cap") {
+                if (!parseNumber(value, memoryCapMb))
+                    return;
+            } else if (key == "scheduler") {
+                if (value == "openmp") {
+                    scheduler = OPENMP_TASKS;
+                } else if (value == "stealing") {
+                    scheduler = WORK_STEALING;
+                } else {
+                    error = "Unknown scheduler: " + value;
+                    return;
+                }
+            } else if (key == "beam-width") {
+                if (!parseNumber(value, beamWidth))
+                    return;
+            } else if (key == "beam-time") {
+                if (!parseNumber(value, beamTimeMs))
+                    return;
+            } else if (key == "task-depth") {
+                if (!parseNumber(value, taskDepth))
+                    return;
+            } else if (key == "task-slack") {
+                if (!parseNumber(value, taskSlack))
+                    return;
+            } else if (key == "mode") {
+                if (value == "bnb") {
+                    mode = BRANCH_AND_BOUND;
+                } else if (value == "idastar") {
+                    mode = IDA_STAR;
+                } else if (value == "bidir") {
+                    mode = BIDIRECTIONAL;
+                } else if (value == "bfs") {
+                    mode = LAYERED_BFS;
+                } else if (value == "extbfs") {
+                    mode = EXTERNAL_BFS;
+                } else {
+                    error = "Unknown mode: " + value;
+                    return;
+                }
+            } else if (key == "bound") {
+                if (value == "nearest") {
+                    bound = NEAREST;
+                } else if (value == "assignment") {
+                    bound = ASSIGNMENT;
+                } else {
+                    error = "Unknown bound: " + value;
+                    return;
+                }
+            } else if (key == "parity-bound") {
+                if (!parseSwitch(value, parityBound))
+                    return;
+            } else if (key == "symmetry") {
+                if (!parseSwitch(value, symmetry))
+                    return;
+            } else if (key == "delta-tasks") {
+                if (!parseSwitch(value, deltaTasks))
+                    return;
+            } else if (key == "bound-window") {
+                if (!parseSwitch(value, boundWindow))
+                    return;
+            } else if (key == "comm-thread") {
+                if (!parseSwitch(value, commThread))
+                    return;
+            } else if (key == "partial-order") {
+                if (!parseSwitch(value, partialOrder))
+                    return;
+            } else if (key == "engine") {
+                if (value == "copy") {
+                    engine = COPY;
+                } else if (value == "inplace") {
+                    engine = IN_PLACE;
+                } else {
+                    error = "Unknown engine: " + value;
+                    return;
+                }
+            } else {
+                error = "Unknown option: " + arg;
+                return;
+            }
+        }
+
+        if (inputPath.empty())
+            error = "The input file path must be provided as an argument!";
+    }
+
+    bool isValid() const {
+        return error.empty();
+    }
+
+    static string usage() {
+        return "Usage: knight_swap [options] <input file>\n"
+               "  --mode=bnb|idastar|bidir|bfs|extbfs\n"
+               "                                search strategy (default bnb)\n"
+               "  --bound=nearest|assignment    lower bound heuristic (default nearest)\n"
+               "  --parity-bound=on|off         round the bound of each color up to the parity of its remaining moves (default on)\n"
+               "  --symmetry=on|off             explore positions symmetric by a reflection or rotation of the board only once (default on)\n"
+               "  --partial-order=on|off        skip the orders of independent moves which lead to the same position (default off)\n"
+               "  --beam-width=<n>              states per step of the beam search finding the first upper bound, 0 disables it (default 64)\n"
+               "  --beam-time=<ms>              time limit of the beam search, it gives up when it is reached (default 2000)\n"
+               "  --tt-size=<MB>                memory budget of the transposition table per rank, 0 disables it (default 64)\n"
+               "  --engine=copy|inplace         how the slaves create child states (default copy)\n"
+               "  --spill-dir=<dir>             directory for the layer files of extbfs (default /tmp)\n"
+               "  --memory-cap=<MB>             memory for the buffers of extbfs before they are written to disk (default 1024)\n"
+               "  --delta-tasks=on|off          send tasks and solutions as moves from the initial state, the slaves replay them (default on)\n"
+               "  --bound-window=on|off         share the best solution size in an MPI window on the master instead of messages (default off)\n"
+               "  --comm-thread=on|off          one thread of each slave does all its MPI calls, the search threads none (default on)\n"
+               "  --scheduler=openmp|stealing   how the slaves distribute tasks among their threads (default openmp)\n"
+               "  --task-depth=<n>              slaves spawn OpenMP tasks only in the first n levels of a subproblem (default 3)\n"
+               "  --task-slack=<moves>          deeper nodes spawn tasks too if upper bound - step - lower bound is at least this (default 0 = off)";
+    }
+
+    /**
+     * Description of the first problem found while parsing, empty if the arguments are valid
+     */
+    string error;
+    string inputPath;
+    Mode mode = BRANCH_AND_BOUND;
+    Bound bound = NEAREST;
+    bool parityBound = true;
+    bool symmetry = true;
+    bool partialOrder = false;
+    /**
+     * Memory budget of the transposition table in megabytes
+     */
+    size_t ttSizeMb = 64;
+    Engine engine = COPY;
+    Scheduler scheduler = OPENMP_TASKS;
+    /**
+     * Whether the tasks, the donations and the solutions of the slaves carry just the moves instead of whole states
+     */
+    bool deltaTasks = true;
+    /**
+     * Whether the slaves exchange the upper bound through the IncumbentWindow instead of the SOLUTION_SIZE_UPDATE messages
+     */
+    bool boundWindow = false;
+    /**
+     * Whether a dedicated thread of each slave exchanges the bounds, the work requests and the donations
+     * while the search threads never call MPI; otherwise the search threads call it one at a time
+     */
+    bool commThread = true;
+    string spillDirectory = "/tmp";
+    size_t memoryCapMb = 1024;
+    /**
+     * Width of the beam search run by the master before the branch and bound to find the initial upper bound
+     */
+    size_t beamWidth = 64;
+    /**
+     * Time limit of the beam search in milliseconds, so it cannot take longer than the search it is to speed up
+     */
+    size_t beamTimeMs = 2000;
+    /**
+     * Task granularity of the slaves - a node spawns a task per child if it is less than taskDepth steps
+     * below the root of the subproblem or if its slack (upper bound - step - lower bound) is at least taskSlack,
+     * the other nodes are searched by a sequential DFS
+     */
+    size_t taskDepth = 3;
+    size_t taskSlack = 0;
+
+private:
+    bool parseSwitch(const string & value, bool & res) {
+        if (value == "on") {
+            res = true;
+            return true;
+        }
+        if (value == "off") {
+            res = false;
+            return true;
+        }
+
+        error = "Invalid switch value (on|off expected): " + value;
+        return false;
+    }
+
+    bool parseNumber(const string & value, size_t & res) {
+        try {
+            size_t idx;
+            unsigned long long parsed = stoull(value, &idx);
+            if (idx == value.size() && value[0] != '-') {
+                res = (size_t)parsed;
+                return true;
+            }
+        } catch (const exception &) {
+        }
+
+        error = "Invalid numeric value: " + value;
+        return false;
+    }
+};
+
+#endif //KNIGHT_SWAP_SOLVEROPTIONS_H
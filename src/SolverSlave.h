@@ -2,11 +2,22 @@
 #define KNIGHT_SWAP_SOLVERSLAVE_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <omp.h>
 #include <mpi.h>
 #include "Types.h"
 #include "BoardState.h"
+#include "TranspositionTable.h"
+#include "SolverOptions.h"
+#include "LowerBoundHeuristic.h"
+#include "IncumbentWindow.h"
+#include "WorkStealingPool.h"
 
 using namespace std;
 
@@ -15,182 +26,621 @@ using namespace std;
  */
 class SolverSlave {
 public:
-    explicit SolverSlave(const InstanceInfo & instanceInfo, size_t initLowerBound, size_t upperBound, int rank) :
+    explicit SolverSlave(const InstanceInfo & instanceInfo, const SolverOptions & options, TranspositionTable & transpositionTable,
+                         IncumbentWindow & incumbent, size_t initLowerBound, size_t upperBound, int rank) :
         instanceInfo(instanceInfo),
+        options(options),
+        lowerBoundHeuristic(instanceInfo, options.bound, options.parityBound),
+        transpositionTable(transpositionTable),
+        incumbent(incumbent),
         initLowerBound(initLowerBound),
         upperBound(upperBound),
         rank(rank),
-        solutionSizeUpdateBuffer(1) {
+        solutionSizeUpdateBuffer(1),
+        nodeCounters(omp_get_max_threads()) {
     }
 
     /**
      * Finds a solution and stores it internally
      */
     void solve(BoardState & boardState, int step) {
-        #pragma omp parallel
-        {
-            #pragma omp single
-            solveInner(boardState, step);
+        rootStep = step;
+        boardState.hashes = transpositionTable.hash(boardState.whites, boardState.blacks);
+
+        // the search threads do not call MPI while the communication thread runs
+        thread communicator;
+        if (options.commThread) {
+            communicating = true;
+            communicator = thread(&SolverSlave::communicate, this);
+        }
+
+        if (options.scheduler == SolverOptions::WORK_STEALING) {
+            // the threads of the parallel region are the workers of the pool
+            WorkStealingPool<PoolTask> workers(omp_get_max_threads());
+            pool = &workers;
+            workers.push(0, new PoolTask(boardState, step));
+
+            #pragma omp parallel
+            workers.run(omp_get_thread_num(), [this](PoolTask & task) {
+                solveTask(task.boardState, task.step);
+            });
+
+            pool = nullptr;
+        } else {
+            #pragma omp parallel
+            {
+                #pragma omp single
+                solveTask(boardState, step);
+            }
+        }
+
+        if (options.commThread) {
+            {
+                lock_guard<mutex> lock(outboxMutex);
+                communicating = false;
+            }
+            wakeUp.notify_one();
+            communicator.join();
+        }
+
+        // the master waits for an answer to every work request - refuse the ones which were not served
+        if (donationRequested)
+            MPI_Send(nullptr, 0, MPI_BYTE, 0, TAG::WORK_DONATION, MPI_COMM_WORLD);
+        int flag;
+        MPI_Iprobe(0, TAG::WORK_REQUEST, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+        while (flag) {
+            refuseWorkRequest();
+            MPI_Iprobe(0, TAG::WORK_REQUEST, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
         }
 
         // send solution to the master - send even the empty solution to let master know this slave wants another task
+        // the size is the whole one, in the delta mode the master already has the moves up to the task root
         vector<int> buffer;
         buffer.push_back((int)solution.size());
-        for (const auto& item : solution) {
-            buffer.push_back(item.first);
-            buffer.push_back(item.second);
+        size_t firstSent = options.deltaTasks && !solution.empty() ? rootStep : 0;
+        for (size_t i = firstSent; i < solution.size(); ++i) {
+            buffer.push_back(solution[i].first);
+            buffer.push_back(solution[i].second);
+        }
+        size_t nIterations = 0, nPruned = 0, nCutoffs = 0;
+        for (const auto & counter : nodeCounters) {
+            nIterations += counter.value;
+            nPruned += counter.pruned;
+            nCutoffs += counter.cutoffs;
         }
         buffer.push_back((int)nIterations);
+        buffer.push_back((int)nPruned);
+        buffer.push_back((int)min(nCutoffs, (size_t)INT_MAX));
         MPI_Send(buffer.data(), (int)buffer.size(), MPI_INT, 0, TAG::SOLUTION, MPI_COMM_WORLD);
 
         if (!solution.empty())
             cout << "\t[SLAVE " << rank << "] solution of size " << solution.size() << " sent to the master" << endl;
     }
 
+    /**
+     * Receives a work request of the master and answers it with an empty donation
+     * Used when the slave has no task to split
+     */
+    static void refuseWorkRequest() {
+        MPI_Recv(nullptr, 0, MPI_INT, 0, TAG::WORK_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Send(nullptr, 0, MPI_BYTE, 0, TAG::WORK_DONATION, MPI_COMM_WORLD);
+    }
+
+    /**
+     * Copying engine - every child gets its own copy of the board state
+     * Children of the nodes above the task cutoff are explored in separate tasks, the others directly.
+     */
     void solveInner(BoardState & boardState, int step) {
-        #pragma omp critical
-        nIterations++;
+        bool areWhitesOnTurn;
+        if (!visitNode(boardState, step, areWhitesOnTurn))
+            return;
+
+        /* prepare information for all viable next moves (recursive calls) */
+
+        vector<NextMoveInfo> nextMovesInfo;
+        generateMoves(boardState, step, areWhitesOnTurn, nextMovesInfo);
+
+        /* perform all viable next moves (recursive calls) */
+
+        bool spawnTasks = spawnsTasks(boardState, step);
+
+        // the pool runs the newest task first - push the most promising move last
+        if (spawnTasks && pool != nullptr)
+            reverse(nextMovesInfo.begin(), nextMovesInfo.end());
+
+        for (const auto & item : nextMovesInfo) {
+
+            /* prepare a board state for the next call */
+
+            BoardState newBoardState(boardState);
+            newBoardState.makeMove(instanceInfo, areWhitesOnTurn, item.knightIndex, item.nextPos);
+            newBoardState.setColorLowerBound(areWhitesOnTurn, item.nextColorBound);
+            transpositionTable.applyMove(newBoardState.hashes, areWhitesOnTurn, item.currentPos, item.nextPos);
+
+            /* do the call */
+
+            if (spawnTasks) {
+                spawnTask(newBoardState, step + 1);
+            } else {
+                solveInner(newBoardState, step + 1);
+            }
+        }
+    }
+
+private:
+    const InstanceInfo & instanceInfo;
+    const SolverOptions & options;
+    const LowerBoundHeuristic lowerBoundHeuristic;
+    /**
+     * Shared by all the threads and kept across all the subtasks solved by this rank
+     */
+    TranspositionTable & transpositionTable;
+    IncumbentWindow & incumbent;
+
+    /**
+     * To let all threads know they can stop searching
+     * when current solution size reaches the initial board state's lower bound
+     */
+    const size_t initLowerBound;
+    /**
+     * Size of the best solution known to this slave, read by all the threads without locking
+     */
+    atomic<size_t> upperBound;
+    const int rank;
+    /**
+     * Written only in the critical section together with the upper bound
+     */
+    vector<pair<position,position>> solution;
+    vector<int> solutionSizeUpdateBuffer;
+
+    /**
+     * Number of visited nodes, of the child nodes skipped by the partial-order reduction
+     * and of the child nodes cut off by the upper bound, each thread counts in its own cache line
+     */
+    struct alignas(64) NodeCounter {
+        size_t value = 0;
+        size_t pruned = 0;
+        size_t cutoffs = 0;
+    };
+    vector<NodeCounter> nodeCounters;
+
+    /**
+     * Step of the root of the task
+     */
+    int rootStep = 0;
+    /**
+     * Set when the master asked for a part of the task, the first node shallow enough is then donated
+     */
+    atomic<bool> donationRequested{false};
+    /**
+     * Set when the master stops the search, checked in every node
+     */
+    atomic<bool> cancelled{false};
+
+    /**
+     * Initial capacity of a move stack of the in-place engine, enough for any of the test instances
+     */
+    static constexpr size_t MOVE_STACK_RESERVE = 1024;
+    /**
+     * Only the nodes at most this many steps below the task root are donated,
+     * deeper ones are expected to be too small to be worth sending
+     */
+    static constexpr int DONATION_DEPTH = 4;
+    /**
+     * Thread 0 reads the bound from the incumbent window once per this many of its nodes
+     */
+    static constexpr size_t BOUND_POLL_INTERVAL = 256;
+    /**
+     * Longest sleep of the communication thread between two checks for messages
+     */
+    static constexpr chrono::microseconds COMM_POLL_INTERVAL{50};
+
+    /**
+     * Donations prepared by the search threads for the communication thread to send,
+     * guarded by outboxMutex together with the communicating flag
+     */
+    vector<WireWriter> outbox;
+    bool communicating = false;
+    mutex outboxMutex;
+    condition_variable wakeUp;
+
+    /**
+     * Helper structure holding information needed for recursive calls
+     */
+    struct NextMoveInfo {
+        NextMoveInfo(int nextLowerBound, int nextColorBound, int knightIndex, position currentPos, position nextPos) :
+                nextLowerBound(nextLowerBound), nextColorBound(nextColorBound), knightIndex(knightIndex), currentPos(currentPos), nextPos(nextPos) {
+        }
+
+        /**
+         * Lower bound of the next state and of the moving color in it
+         */
+        int nextLowerBound, nextColorBound;
+        int knightIndex, currentPos, nextPos;
+    };
+
+    static bool nextCallComparator(const NextMoveInfo &a, const NextMoveInfo &b) {
+        return a.nextLowerBound < b.nextLowerBound;
+    }
+
+    /**
+     * Node explored by a task of the work-stealing pool
+     */
+    struct PoolTask {
+        PoolTask(const BoardState & boardState, int step) :
+                boardState(boardState), step(step) {
+        }
+
+        BoardState boardState;
+        int step;
+    };
+
+    /**
+     * Set while the work-stealing scheduler runs a task, the OpenMP tasks are used otherwise
+     */
+    WorkStealingPool<PoolTask> * pool = nullptr;
 
-        if (solution.size() == initLowerBound)
+    /**
+     * Explores the subtree of given node by the selected engine
+     */
+    void solveTask(BoardState & boardState, int step) {
+        if (options.engine == SolverOptions::IN_PLACE) {
+            vector<NextMoveInfo> moveStack;
+            moveStack.reserve(MOVE_STACK_RESERVE);
+            boardState.solutionCandidate.reserve(upperBound.load(memory_order_relaxed));
+            solveInPlace(boardState, step, moveStack);
+        } else {
+            solveInner(boardState, step);
+        }
+    }
+
+    /**
+     * Lets the node be explored by another task of the selected scheduler
+     */
+    void spawnTask(BoardState & boardState, int step) {
+        if (pool != nullptr) {
+            pool->push(omp_get_thread_num(), new PoolTask(boardState, step));
             return;
+        }
+
+        #pragma omp task firstprivate(boardState)
+        solveTask(boardState, step);
+    }
+
+    /**
+     * Task cutoff - whether the children of given node are explored in separate tasks
+     *
+     * Only the shallow nodes and the nodes with a lot of slack are worth a task,
+     * below them the task creation and scheduling would cost more than the search itself.
+     */
+    bool spawnsTasks(const BoardState & boardState, int step) const {
+        if ((size_t)(step - rootStep) < options.taskDepth)
+            return true;
+
+        size_t bound = upperBound.load(memory_order_relaxed);
+        return options.taskSlack > 0 && bound > step + boardState.lowerBound
+               && bound - step - boardState.lowerBound >= options.taskSlack;
+    }
+
+    /**
+     * Lowers the upper bound to given size unless it is already at most that small
+     * Returns true if the bound was lowered.
+     */
+    bool lowerUpperBound(size_t size) {
+        size_t current = upperBound.load(memory_order_relaxed);
+        while (size < current) {
+            if (upperBound.compare_exchange_weak(current, size, memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * Work common to both engines done when a node is entered
+     *
+     * Counts the node, exchanges upper bounds with the master and records a solution if the node is one.
+     * Returns false if the node does not need to be expanded.
+     */
+    bool visitNode(BoardState & boardState, int step, bool & areWhitesOnTurn) {
+        nodeCounters[omp_get_thread_num()].value++;
+
+        // a solution of initLowerBound moves was found, no solution can be shorter
+        // the master can tell so even before the bound gets here, the outstanding tasks then end at once
+        if (upperBound.load(memory_order_relaxed) <= initLowerBound || cancelled.load(memory_order_relaxed))
+            return false;
 
         // check if there is a better upper bound found by another slave
         // only one of the threads needs to actually read it - it will then update it for the other threads
-        if (omp_get_thread_num() == 0) {
-
-            // there can be multiple updates - read through all of them
-            int flag = 1;
-            while (flag) {
-                MPI_Iprobe(0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
-                if (flag) {
-                    int bufferSize = 16;
-                    vector<int> message(bufferSize);
-                    MPI_Recv(message.data(), bufferSize, MPI_INT, 0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD,
-                             MPI_STATUS_IGNORE);
-
-                    if (message[0] < upperBound) {
-                        #pragma omp critical
-                        upperBound = message[0];
-                    }
-
-                    cout << "\t[SLAVE " << rank << "] upper bound of size " << solution.size() << " received from the master" << endl;
-                }
+        // the communication thread does it instead when there is one
+        // without it every MPI call of the search threads is in the same critical section, as MPI_THREAD_SERIALIZED requires
+        if (!options.commThread && omp_get_thread_num() == 0) {
+            #pragma omp critical
+            {
+                // a read of the window is a round trip to the master, so it is not done in every node
+                if (!options.boundWindow || nodeCounters[0].value % BOUND_POLL_INTERVAL == 0)
+                    receiveBounds();
+                receiveWorkRequest();
+                receiveStop();
             }
         }
 
         // a (possibly not optimal but the best so far) solution is found
         if (boardState.whitesLeft + boardState.blacksLeft == 0)  {
-            if (!boardState.solutionCandidate.empty() && boardState.solutionCandidate.size() < upperBound) {
+            if (!boardState.solutionCandidate.empty() && boardState.solutionCandidate.size() < upperBound.load(memory_order_relaxed)) {
                 #pragma omp critical
-                if (!boardState.solutionCandidate.empty() && boardState.solutionCandidate.size() < upperBound) {
+                if (lowerUpperBound(boardState.solutionCandidate.size())) {
                     solution = boardState.solutionCandidate;
-                    upperBound = solution.size();
 
                     // send information about the size of the new solution to the master
                     // because the best upper bound known to the master was sent to this slave previously,
                     // this communication will happen only if this solution is better
-                    solutionSizeUpdateBuffer[0] = (int)upperBound;
-                    MPI_Request dummy_handle;
-                    MPI_Isend(solutionSizeUpdateBuffer.data(), (int)solutionSizeUpdateBuffer.size(), MPI_INT, 0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &dummy_handle);
-                    cout << "\t[SLAVE " << rank << "] upper bound of size " << upperBound << " sent to the master" << endl;
+                    if (options.commThread)
+                        wakeUp.notify_one();
+                    else
+                        sendBound(solution.size());
+                    cout << "\t[SLAVE " << rank << "] upper bound of size " << solution.size() << " sent to the master" << endl;
                 }
             }
         }
 
-        /* prepare information for all viable next moves (recursive calls) */
+        areWhitesOnTurn = boardState.whitesOnTurn(step);
 
-        vector<NextMoveInfo> nextMovesInfo;
+        // the same or a symmetric position was already reached in this or an earlier step - nothing new can be found from here
+        if (transpositionTable.probeAndStore(boardState.hashes, areWhitesOnTurn, step, !options.partialOrder))
+            return false;
 
-        bool areWhitesOnTurn = ((step % 2 == 1) && (boardState.whitesLeft > 0)) || (boardState.blacksLeft == 0);
-        const vector<position> & knights = areWhitesOnTurn ? boardState.whites : boardState.blacks;
-        const map<position, int> & knightDistances = areWhitesOnTurn ? instanceInfo.minDistancesWhites : instanceInfo.minDistancesBlacks;
+        // give the node to an idle slave instead of expanding it here
+        if (donationRequested && step > rootStep && step - rootStep <= DONATION_DEPTH && donationRequested.exchange(false)) {
+            donate(boardState, step);
+            return false;
+        }
 
-        for (int i = 0; i < knights.size(); ++i) {
-            position current = knights[i];
+        return true;
+    }
 
-            for (const position & next: instanceInfo.movesForPos.find(current)->second) {
-                if (boardState.boardOccupation[next])
-                    continue;
+    /**
+     * Lets the master (or the window) know about a solution of given size
+     */
+    void sendBound(size_t size) {
+        // in the window mode the other slaves read it from the window themselves
+        if (options.boundWindow) {
+            incumbent.publish((int)size);
+            return;
+        }
 
-                size_t nextLowerBound = boardState.lowerBound - knightDistances.find(current)->second + knightDistances.find(next)->second;
-                if (step + nextLowerBound + 1 >= upperBound) {
-                    continue;
-                }
+        solutionSizeUpdateBuffer[0] = (int)size;
+        MPI_Request dummy_handle;
+        MPI_Isend(solutionSizeUpdateBuffer.data(), (int)solutionSizeUpdateBuffer.size(), MPI_INT, 0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &dummy_handle);
+    }
 
-                nextMovesInfo.emplace_back(nextLowerBound, i, current, next);
-            }
+    /**
+     * Lowers the upper bound to the best one found by the other slaves
+     */
+    void receiveBounds() {
+        if (options.boundWindow) {
+            lowerUpperBound(incumbent.read());
+            return;
         }
 
-        /* perform all viable next moves (recursive calls) */
+        // there can be multiple updates - read through all of them
+        int flag = 1;
+        while (flag) {
+            MPI_Iprobe(0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+            if (flag) {
+                int bufferSize = 16;
+                vector<int> message(bufferSize);
+                MPI_Recv(message.data(), bufferSize, MPI_INT, 0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD,
+                         MPI_STATUS_IGNORE);
 
-        sort(nextMovesInfo.begin(), nextMovesInfo.end(), nextCallComparator);
+                lowerUpperBound(message[0]);
 
-        for (const auto & item : nextMovesInfo) {
-            int i = item.knightIndex;
-            position current = item.currentPos;
-            position next = item.nextPos;
-            int nextLowerBound = item.nextLowerBound;
+                cout << "\t[SLAVE " << rank << "] upper bound of size " << message[0] << " received from the master" << endl;
+            }
+        }
+    }
 
-            /* prepare a board state for the next call */
+    /**
+     * An idle slave wants some work - the first node shallow enough will be donated
+     * The master never asks again before it is answered.
+     */
+    void receiveWorkRequest() {
+        int flag;
+        MPI_Iprobe(0, TAG::WORK_REQUEST, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+        if (flag) {
+            MPI_Recv(nullptr, 0, MPI_INT, 0, TAG::WORK_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            donationRequested = true;
+        }
+    }
 
-            BoardState newBoardState(boardState);
+    /**
+     * The master found out the solution cannot be improved - the search is abandoned
+     */
+    void receiveStop() {
+        int flag;
+        MPI_Iprobe(0, TAG::STOP, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+        if (flag) {
+            MPI_Recv(nullptr, 0, MPI_INT, 0, TAG::STOP, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            cancelled = true;
+            cout << "\t[SLAVE " << rank << "] stopped by the master" << endl;
+        }
+    }
 
-            if (areWhitesOnTurn) {
-                newBoardState.whites[i] = next;
+    /**
+     * Loop of the communication thread, the only thread of the slave calling MPI while the search runs
+     *
+     * It wakes up when a search thread finds a solution or prepares a donation, and at least once per
+     * COMM_POLL_INTERVAL to receive the bounds and the work requests. The donations are sent even after
+     * the search ends, so every request taken by a search thread is answered.
+     */
+    void communicate() {
+        // the bound the master knows about from this slave or has sent to it
+        size_t sharedBound = upperBound.load(memory_order_relaxed);
+
+        unique_lock<mutex> lock(outboxMutex);
+        while (true) {
+            for (const auto & donation : outbox)
+                donation.send(0, TAG::WORK_DONATION);
+            outbox.clear();
+            if (!communicating)
+                return;
+            lock.unlock();
+
+            size_t bound = upperBound.load(memory_order_relaxed);
+            if (bound < sharedBound) {
+                sendBound(bound);
+                sharedBound = bound;
+            }
+            receiveBounds();
+            sharedBound = min(sharedBound, upperBound.load(memory_order_relaxed));
+            receiveWorkRequest();
+            receiveStop();
+
+            lock.lock();
+            wakeUp.wait_for(lock, COMM_POLL_INTERVAL, [this, &sharedBound] {
+                return !outbox.empty() || !communicating || upperBound.load(memory_order_relaxed) < sharedBound;
+            });
+        }
+    }
 
-                if (instanceInfo.squareType[current] == BLACK)
-                    newBoardState.whitesLeft++;
-                if (instanceInfo.squareType[next] == BLACK)
-                    newBoardState.whitesLeft--;
-            } else {
-                newBoardState.blacks[i] = next;
+    /**
+     * Sends the node to the master to be solved by another slave
+     */
+    void donate(BoardState & boardState, int step) {
+        WireWriter out(instanceInfo.nSquares);
+        out.putNumber(step);
+        if (options.deltaTasks)
+            boardState.serializeMoves(out);
+        else
+            boardState.serialize(out);
+
+        if (options.commThread) {
+            lock_guard<mutex> lock(outboxMutex);
+            outbox.push_back(std::move(out));
+            wakeUp.notify_one();
+        } else {
+            #pragma omp critical
+            out.send(0, TAG::WORK_DONATION);
+        }
 
-                if (instanceInfo.squareType[current] == WHITE)
-                    newBoardState.blacksLeft++;
-                if (instanceInfo.squareType[next] == WHITE)
-                    newBoardState.blacksLeft--;
-            }
+        cout << "\t[SLAVE " << rank << "] state of step " << step << " donated" << endl;
+    }
 
-            newBoardState.boardOccupation[current] = false;
-            newBoardState.boardOccupation[next] = true;
-            newBoardState.lowerBound = nextLowerBound;
-            newBoardState.solutionCandidate.emplace_back(current, next);
+    /**
+     * Appends all the viable moves from given node to the vector, the most promising ones first
+     */
+    void generateMoves(const BoardState & boardState, int step, bool areWhitesOnTurn, vector<NextMoveInfo> & moves) {
+        size_t movesBegin = moves.size();
+
+        nodeCounters[omp_get_thread_num()].cutoffs += boardState.forEachMove(instanceInfo, lowerBoundHeuristic, step, upperBound.load(memory_order_relaxed),
+                               [&](int knightIndex, position current, position next, int nextColorBound, size_t nextLowerBound) {
+            if (options.partialOrder && isReorderedMove(boardState, step, areWhitesOnTurn, current, next)) {
+                nodeCounters[omp_get_thread_num()].pruned++;
+                return;
+            }
 
-            /* do the call */
+            moves.emplace_back(nextLowerBound, nextColorBound, knightIndex, current, next);
+        });
 
-            #pragma omp task
-            solveInner(newBoardState, step + 1);
-        }
+        sort(moves.begin() + (long)movesBegin, moves.end(), nextCallComparator);
     }
 
-private:
-    const InstanceInfo & instanceInfo;
+    static bool sharesSquare(const pair<position,position> & a, const pair<position,position> & b) {
+        return a.first == b.first || a.first == b.second || a.second == b.first || a.second == b.second;
+    }
 
     /**
-     * To let all threads know they can stop searching
-     * when current solution size reaches the initial board state's lower bound
+     * Partial-order reduction - whether the move from -> to is a reordering of the moves which is explored elsewhere
+     *
+     * Moves m1, m2, m3 on disjoint squares, where m1 and m3 are made by the same color, lead to the same position
+     * as m3, m2, m1 if the colors on turn stay the same (a color moves every step once the other one is done).
+     * Only the order with the smaller of m1 and m3 first is explored. Every sequence of moves can be sorted
+     * by such swaps into one without any of them, of the same length and to the same position, so an optimal
+     * solution is never lost. The move m1 must be made within this task, otherwise the other order is not in it.
      */
-    const size_t initLowerBound;
-    size_t upperBound{};
-    const int rank;
-    vector<pair<position,position>> solution;
-
-    size_t nIterations = 0;
-    vector<int> solutionSizeUpdateBuffer;
+    bool isReorderedMove(const BoardState & boardState, int step, bool white, position from, position to) const {
+        const vector<pair<position,position>> & moves = boardState.solutionCandidate;
+        if (step - 2 < rootStep || moves.size() < 2)
+            return false;
+
+        const pair<position,position> & m1 = moves[moves.size() - 2];
+        const pair<position,position> & m2 = moves[moves.size() - 1];
+        pair<position,position> m3(from, to);
+        if (!(m3 < m1) || sharesSquare(m1, m2) || sharesSquare(m1, m3) || sharesSquare(m2, m3))
+            return false;
+
+        // the knights of m1 and m2 are still on their target squares
+        bool white1 = boardState.whitesMask.test(m1.second);
+        bool white2 = boardState.whitesMask.test(m2.second);
+        if (white1 != white)
+            return false;
+
+        // knights left of both colors two steps back, then after m3 and after m3, m2
+        int left[2] = {boardState.whitesLeft, boardState.blacksLeft};
+        auto apply = [&](const pair<position,position> & move, bool moveWhite, int sign) {
+            SquareType destination = moveWhite ? BLACK : WHITE;
+            int delta = (instanceInfo.squareType[move.first] == destination) - (instanceInfo.squareType[move.second] == destination);
+            left[moveWhite ? 0 : 1] += sign * delta;
+        };
+        apply(m2, white2, -1);
+        apply(m1, white1, -1);
+
+        apply(m3, white, 1);
+        if (left[0] + left[1] == 0 || BoardState::whitesOnTurn(step - 1, left[0], left[1]) != white2)
+            return false;
+        apply(m2, white2, 1);
+        return left[0] + left[1] > 0 && BoardState::whitesOnTurn(step, left[0], left[1]) == white;
+    }
 
     /**
-     * Helper structure holding information needed for recursive calls
+     * In-place engine - moves are made on the given board state and taken back after the recursive call
+     *
+     * Only the nodes above the task cutoff spawn tasks, and those take a snapshot of the state;
+     * below them the search is a plain sequential DFS.
+     * Moves of all the nodes on the current path are kept on one stack, so the hot loop does not allocate.
      */
-    struct NextMoveInfo {
-        NextMoveInfo(int nextLowerBound, int knightIndex, position currentPos, position nextPos) :
-                nextLowerBound(nextLowerBound), knightIndex(knightIndex), currentPos(currentPos), nextPos(nextPos) {
-        }
+    void solveInPlace(BoardState & boardState, int step, vector<NextMoveInfo> & moveStack) {
+        bool areWhitesOnTurn;
+        if (!visitNode(boardState, step, areWhitesOnTurn))
+            return;
 
-        int nextLowerBound, knightIndex, currentPos, nextPos;
-    };
+        size_t movesBegin = moveStack.size();
+        generateMoves(boardState, step, areWhitesOnTurn, moveStack);
+        size_t movesEnd = moveStack.size();
 
-    static bool nextCallComparator(const NextMoveInfo &a, const NextMoveInfo &b) {
-        return a.nextLowerBound < b.nextLowerBound;
+        bool spawnTasks = spawnsTasks(boardState, step);
+
+        // the pool runs the newest task first - push the most promising move last
+        if (spawnTasks && pool != nullptr)
+            reverse(moveStack.begin() + (long)movesBegin, moveStack.end());
+
+        for (size_t m = movesBegin; m < movesEnd; ++m) {
+            // copied as the recursive call may reallocate the stack
+            const NextMoveInfo item = moveStack[m];
+
+            if (spawnTasks) {
+                BoardState newBoardState(boardState);
+                newBoardState.makeMove(instanceInfo, areWhitesOnTurn, item.knightIndex, item.nextPos);
+                newBoardState.setColorLowerBound(areWhitesOnTurn, item.nextColorBound);
+                transpositionTable.applyMove(newBoardState.hashes, areWhitesOnTurn, item.currentPos, item.nextPos);
+
+                spawnTask(newBoardState, step + 1);
+                continue;
+            }
+
+            int colorBound = areWhitesOnTurn ? boardState.lowerBoundWhites : boardState.lowerBoundBlacks;
+
+            boardState.makeMove(instanceInfo, areWhitesOnTurn, item.knightIndex, item.nextPos);
+            boardState.setColorLowerBound(areWhitesOnTurn, item.nextColorBound);
+            transpositionTable.applyMove(boardState.hashes, areWhitesOnTurn, item.currentPos, item.nextPos);
+
+            solveInPlace(boardState, step + 1, moveStack);
+
+            boardState.undoMove(instanceInfo, areWhitesOnTurn, item.knightIndex);
+            boardState.setColorLowerBound(areWhitesOnTurn, colorBound);
+            transpositionTable.applyMove(boardState.hashes, areWhitesOnTurn, item.currentPos, item.nextPos);
+        }
+
+        moveStack.erase(moveStack.begin() + (long)movesBegin, moveStack.end());
     }
 };
 
@@ -0,0 +1,159 @@
+#ifndef KNIGHT_SWAP_TRANSPOSITIONTABLE_H
+#define KNIGHT_SWAP_TRANSPOSITIONTABLE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include "InstanceInfo.h"
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Fixed-size table of already visited positions shared by all the threads of one rank
+ *
+ * A position is identified by a Zobrist hash of the knight positions and of the side on turn,
+ * the smallest one of the hashes of its images by the symmetries of the instance, so the symmetric positions
+ * share one entry. The table remembers the smallest step in which the position was reached.
+ * Entries are accessed without locks - the key is stored xor-ed with the data,
+ * so an entry torn by concurrent writes just does not match and is treated as empty.
+ */
+class TranspositionTable {
+public:
+    /**
+     * Hashes of one position mapped by each of the symmetries, only the first nSymmetries of them are used
+     */
+    typedef array<uint64_t, InstanceInfo::MAX_SYMMETRIES> Hashes;
+
+    explicit TranspositionTable(int nSquares, const vector<vector<position>> & symmetries, size_t sizeMb) :
+            nSquares(nSquares),
+            nSymmetries((int)symmetries.size()),
+            zobristWhites(symmetries.size() * nSquares),
+            zobristBlacks(symmetries.size() * nSquares) {
+
+        // fixed seed so every run hashes the same way
+        mt19937_64 generator(0x4b6e69676874ULL);
+        vector<uint64_t> squareWhites(nSquares), squareBlacks(nSquares);
+        for (position pos = 0; pos < nSquares; ++pos) {
+            squareWhites[pos] = generator();
+            squareBlacks[pos] = generator();
+        }
+        zobristWhitesOnTurn = generator();
+
+        // the k-th hash of a position is the plain hash of its image by the k-th symmetry
+        for (int k = 0; k < nSymmetries; ++k) {
+            for (position pos = 0; pos < nSquares; ++pos) {
+                zobristWhites[k * nSquares + pos] = squareWhites[symmetries[k][pos]];
+                zobristBlacks[k * nSquares + pos] = squareBlacks[symmetries[k][pos]];
+            }
+        }
+
+        // round the number of entries down to a power of two so the index is just a mask
+        size_t nEntries = sizeMb * 1024 * 1024 / sizeof(Entry);
+        if (nEntries == 0)
+            return;
+        size_t size = 1;
+        while (size * 2 <= nEntries)
+            size *= 2;
+
+        entries.reset(new Entry[size]);
+        indexMask = size - 1;
+        clear();
+    }
+
+    bool isEnabled() const {
+        return entries != nullptr;
+    }
+
+    /**
+     * Zobrist hashes of given knight positions (the side on turn is not included)
+     */
+    Hashes hash(const vector<position> & whites, const vector<position> & blacks) const {
+        Hashes res{};
+        for (int k = 0; k < nSymmetries; ++k) {
+            for (const auto & pos : whites)
+                res[k] ^= zobristWhites[k * nSquares + pos];
+            for (const auto & pos : blacks)
+                res[k] ^= zobristBlacks[k * nSquares + pos];
+        }
+        return res;
+    }
+
+    /**
+     * Updates the hashes when a knight of given color moves from one square to another, the same call takes it back
+     */
+    void applyMove(Hashes & hashes, bool white, position from, position to) const {
+        const vector<uint64_t> & zobrist = white ? zobristWhites : zobristBlacks;
+        for (int k = 0; k < nSymmetries; ++k)
+            hashes[k] ^= zobrist[k * nSquares + from] ^ zobrist[k * nSquares + to];
+    }
+
+    /**
+     * Records that the position was reached in given step
+     *
+     * Returns true if the position or a symmetric one was already reached in the same or an earlier step,
+     * so everything reachable from it now was (or is being) explored from there
+     * If the subtree explored below a position depends on the path to it (the partial-order reduction),
+     * a position reached in the same step is not pruned - only one reached strictly earlier,
+     * which would mean the current path cannot lead to an optimal solution.
+     */
+    bool probeAndStore(const Hashes & hashes, bool whitesOnTurn, int step, bool pruneSameStep = true) {
+        if (!isEnabled())
+            return false;
+
+        // the smallest of the hashes is the same for all the symmetric positions
+        uint64_t hash = hashes[0];
+        for (int k = 1; k < nSymmetries; ++k)
+            hash = min(hash, hashes[k]);
+
+        uint64_t key = whitesOnTurn ? hash ^ zobristWhitesOnTurn : hash;
+        Entry & entry = entries[key & indexMask];
+
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        uint64_t check = entry.check.load(memory_order_relaxed);
+        if ((check ^ data) == key && (data < (uint64_t)step || (pruneSameStep && data == (uint64_t)step)))
+            return true;
+
+        entry.data.store((uint64_t)step, memory_order_relaxed);
+        entry.check.store(key ^ (uint64_t)step, memory_order_relaxed);
+        return false;
+    }
+
+    /**
+     * Forgets all the stored positions
+     */
+    void clear() {
+        if (!isEnabled())
+            return;
+
+        // data of an empty entry is larger than any step, so it never causes pruning
+        for (size_t i = 0; i <= indexMask; ++i) {
+            entries[i].data.store(EMPTY, memory_order_relaxed);
+            entries[i].check.store(EMPTY, memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Entry {
+        atomic<uint64_t> check;
+        atomic<uint64_t> data;
+    };
+
+    static constexpr uint64_t EMPTY = ~0ULL;
+
+    const int nSquares, nSymmetries;
+    /**
+     * Random values of the squares for each of the symmetries, zobrist[k * nSquares + pos]
+     */
+    vector<uint64_t> zobristWhites, zobristBlacks;
+    uint64_t zobristWhitesOnTurn;
+
+    unique_ptr<Entry[]> entries;
+    size_t indexMask = 0;
+};
+
+#endif //KNIGHT_SWAP_TRANSPOSITIONTABLE_H
@@ -24,7 +24,10 @@ enum TAG {
     BOARD_STATE_OTHERS,
     SOLUTION_SIZE_UPDATE,
     SOLUTION,
-    END
+    END,
+    WORK_REQUEST,
+    WORK_DONATION,
+    STOP
 };
 
 #endif //KNIGHT_SWAP_TYPES_H
@@ -0,0 +1,100 @@
+#ifndef KNIGHT_SWAP_WIREFORMAT_H
+#define KNIGHT_SWAP_WIREFORMAT_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <mpi.h>
+#include "Types.h"
+
+using namespace std;
+
+/***
+ * Compact binary format of the messages carrying board states and instance info
+ *
+ * A message starts with the version of the format and the number of squares of the board.
+ * Numbers and squares are unsigned varints (7 bits per byte, so the small ones take one byte - squares of boards
+ * of up to 128 squares take one byte, of up to 16384 squares two bytes). Messages are received into buffers
+ * of exactly their size, so there is no limit on the size of the board or of the solution.
+ */
+class WireWriter {
+public:
+    explicit WireWriter(int nSquares) {
+        buffer.push_back(WIRE_VERSION);
+        putNumber(nSquares);
+    }
+
+    /**
+     * Version of the format, a rank receiving another one stops instead of misreading the message
+     */
+    static constexpr uint8_t WIRE_VERSION = 2;
+
+    void putNumber(uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back((uint8_t)value);
+    }
+
+    void putSquare(position pos) {
+        putNumber((uint64_t)pos);
+    }
+
+    void send(int destination, int tag) const {
+        MPI_Send(buffer.data(), (int)buffer.size(), MPI_BYTE, destination, tag, MPI_COMM_WORLD);
+    }
+
+private:
+    vector<uint8_t> buffer;
+};
+
+class WireReader {
+public:
+    explicit WireReader(vector<uint8_t> message) :
+            buffer(std::move(message)) {
+        if (buffer.empty() || buffer[index++] != WireWriter::WIRE_VERSION)
+            throw runtime_error("Unsupported version of the message format");
+        nSquares = (int)getNumber();
+    }
+
+    /**
+     * Receives a message of given tag sized by MPI_Probe and MPI_Get_count
+     * Returns an empty vector for an empty message.
+     */
+    static vector<uint8_t> receive(int source, int tag, MPI_Status * status = MPI_STATUS_IGNORE) {
+        MPI_Status probed;
+        MPI_Probe(source, tag, MPI_COMM_WORLD, &probed);
+        int count;
+        MPI_Get_count(&probed, MPI_BYTE, &count);
+
+        vector<uint8_t> res(count);
+        MPI_Recv(res.data(), count, MPI_BYTE, probed.MPI_SOURCE, tag, MPI_COMM_WORLD, status);
+        return res;
+    }
+
+    uint64_t getNumber() {
+        uint64_t res = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = buffer.at(index++);
+            res |= (uint64_t)(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                return res;
+        }
+    }
+
+    position getSquare() {
+        return (position)getNumber();
+    }
+
+    /**
+     * Number of squares of the board written in the header
+     */
+    int nSquares;
+
+private:
+    const vector<uint8_t> buffer;
+    size_t index = 0;
+};
+
+#endif //KNIGHT_SWAP_WIREFORMAT_H
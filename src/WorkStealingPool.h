@@ -0,0 +1,182 @@
+#ifndef KNIGHT_SWAP_WORKSTEALINGPOOL_H
+#define KNIGHT_SWAP_WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/***
+ * Chase-Lev work-stealing deque of task pointers
+ *
+ * The owner pushes and pops at the bottom (newest first), any other thread steals from the top (oldest first).
+ * The circular array grows when it is full, the replaced arrays are kept until the deque is destroyed
+ * because a thief may still be reading from them.
+ */
+template<typename T>
+class ChaseLevDeque {
+public:
+    explicit ChaseLevDeque(size_t capacity = 256) {
+        arrays.emplace_back(new Array(capacity));
+        array.store(arrays.back().get(), memory_order_relaxed);
+    }
+
+    /**
+     * Owner only
+     */
+    void push(T * item) {
+        long b = bottom.load(memory_order_relaxed);
+        long t = top.load(memory_order_acquire);
+        Array * a = array.load(memory_order_relaxed);
+
+        if (b - t >= (long)a->capacity)
+            a = grow(a, t, b);
+
+        a->put(b, item);
+        atomic_thread_fence(memory_order_release);
+        bottom.store(b + 1, memory_order_relaxed);
+    }
+
+    /**
+     * Owner only, returns nullptr if the deque is empty
+     */
+    T * pop() {
+        long b = bottom.load(memory_order_relaxed) - 1;
+        Array * a = array.load(memory_order_relaxed);
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        long t = top.load(memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+
+        T * item = a->get(b);
+        if (t == b) {
+            // the last item - race with the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                item = nullptr;
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /**
+     * Any thread, returns nullptr if the deque is empty or another thread won the item
+     */
+    T * steal() {
+        long t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        long b = bottom.load(memory_order_acquire);
+
+        if (t >= b)
+            return nullptr;
+
+        Array * a = array.load(memory_order_acquire);
+        T * item = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+private:
+    struct Array {
+        explicit Array(size_t capacity) :
+                capacity(capacity),
+                items(new atomic<T *>[capacity]) {
+        }
+
+        const size_t capacity;
+        unique_ptr<atomic<T *>[]> items;
+
+        T * get(long i) const {
+            return items[(size_t)i % capacity].load(memory_order_relaxed);
+        }
+
+        void put(long i, T * item) {
+            items[(size_t)i % capacity].store(item, memory_order_relaxed);
+        }
+    };
+
+    atomic<long> top{0}, bottom{0};
+    atomic<Array *> array;
+    vector<unique_ptr<Array>> arrays;
+
+    Array * grow(Array * a, long t, long b) {
+        arrays.emplace_back(new Array(a->capacity * 2));
+        Array * res = arrays.back().get();
+        for (long i = t; i < b; ++i)
+            res->put(i, a->get(i));
+        array.store(res, memory_order_release);
+        return res;
+    }
+};
+
+/***
+ * Pool of workers executing tasks which can spawn more tasks
+ *
+ * Every worker has its own deque - it runs its newest task first (depth-first, cache friendly)
+ * and when it has none, it steals the oldest task (the shallowest, so the largest) of a random victim.
+ * The caller provides the threads, each of them calls run with its worker index.
+ */
+template<typename T>
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int nWorkers) {
+        for (int i = 0; i < nWorkers; ++i)
+            deques.emplace_back(new ChaseLevDeque<T>());
+    }
+
+    /**
+     * Adds a task to the deque of given worker, the pool takes the ownership
+     * Only the worker itself (or any thread before the workers start) may push to its deque.
+     */
+    void push(int worker, T * task) {
+        pending.fetch_add(1, memory_order_relaxed);
+        deques[worker]->push(task);
+    }
+
+    /**
+     * Executes tasks until all the pushed tasks (including the ones pushed by the tasks) are done
+     */
+    template<typename F>
+    void run(int worker, F execute) {
+        mt19937 generator(worker);
+        int nDeques = (int)deques.size();
+
+        while (pending.load(memory_order_acquire) > 0) {
+            T * task = deques[worker]->pop();
+
+            for (int i = 0; task == nullptr && i < nDeques - 1; ++i) {
+                int victim = (int)(generator() % nDeques);
+                if (victim != worker)
+                    task = deques[victim]->steal();
+            }
+
+            // nothing to do now - let the other threads run instead of spinning on the deques
+            if (task == nullptr) {
+                this_thread::yield();
+                continue;
+            }
+
+            execute(*task);
+            delete task;
+
+            // the children of the task were pushed before, so the count reaches zero only when everything is done
+            pending.fetch_sub(1, memory_order_acq_rel);
+        }
+    }
+
+private:
+    vector<unique_ptr<ChaseLevDeque<T>>> deques;
+    /**
+     * Tasks pushed and not finished yet
+     */
+    atomic<long> pending{0};
+};
+
+#endif //KNIGHT_SWAP_WORKSTEALINGPOOL_H
@@ -5,23 +5,35 @@
 #include "BoardState.h"
 #include "SolverMaster.h"
 #include "SolverSlave.h"
+#include "SolverOptions.h"
+#include "TranspositionTable.h"
+#include "LowerBoundHeuristic.h"
+#include "IncumbentWindow.h"
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    MPI_Init(&argc, &argv);
+    // the communication thread of a slave (or any search thread without it) calls MPI,
+    // but never at the same time as the other threads
+    int threadSupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &threadSupport);
 
     int rank, nSlaves;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &nSlaves);
     nSlaves--; // do not count master
 
+    SolverOptions options(argc, argv);
+    if (options.isValid() && threadSupport < MPI_THREAD_SERIALIZED)
+        options.error = "MPI does not support calls from multiple threads (MPI_THREAD_SERIALIZED is needed)!";
+
     /* master */
     if (rank == 0) {
         cout << "[MASTER] spawn" << endl;
 
-        if (argc != 2) {
-            cerr << "The input file path must be provided as an argument!" << endl;
+        if (!options.isValid()) {
+            cerr << options.error << endl;
+            cerr << SolverOptions::usage() << endl;
 
             // tell the slaves to end and exit
             for (int i = 1; i <= nSlaves; ++i) {
@@ -34,18 +46,23 @@ int main(int argc, char* argv[]) {
         }
 
         // parse input
-        const InputData inputData(argv[1]);
+        double preprocessingStart = MPI_Wtime();
+        const InputData inputData(options.inputPath);
         const InstanceInfo instanceInfo = InstanceInfoBuilder({inputData}).build();
-        BoardState boardState = BoardStateBuilder({instanceInfo}).build();
+        const LowerBoundHeuristic lowerBoundHeuristic(instanceInfo, options.bound, options.parityBound);
+        BoardState boardState = BoardStateBuilder(instanceInfo, lowerBoundHeuristic).build();
+        cout << "[MASTER] instance prepared in " << (MPI_Wtime() - preprocessingStart) * 1000 << " ms" << endl;
 
         // send parsed instance info to the slaves
-        vector<int> message = instanceInfo.serialize();
+        WireWriter out(instanceInfo.nSquares);
+        instanceInfo.serialize(out);
         for (int i = 1; i <= nSlaves; ++i) {
-            MPI_Send(message.data(), (int)message.size(), MPI_INT, i, TAG::INSTANCE_INFO, MPI_COMM_WORLD);
+            out.send(i, TAG::INSTANCE_INFO);
         }
 
         // start solving
-        SolverMaster master(inputData, instanceInfo, nSlaves);
+        IncumbentWindow incumbent(options.boundWindow);
+        SolverMaster master(inputData, instanceInfo, options, incumbent, nSlaves);
         master.solve(boardState, 0);
         master.printSolution();
 
@@ -59,19 +76,25 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        int bufferSize = 2 + 400 * 11 + 1500;
-        vector<int> message(bufferSize);
-
         // get instance info
-        MPI_Recv(message.data(), bufferSize, MPI_INT, 0, TAG::INSTANCE_INFO, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        const InstanceInfo instanceInfo = InstanceInfo::deserialize(message);
+        WireReader instanceMessage(WireReader::receive(0, TAG::INSTANCE_INFO));
+        const InstanceInfo instanceInfo = InstanceInfo::deserialize(instanceMessage);
+        const LowerBoundHeuristic lowerBoundHeuristic(instanceInfo, options.bound, options.parityBound);
+        BoardStateBuilder rootBuilder(instanceInfo, lowerBoundHeuristic);
+        TranspositionTable transpositionTable(instanceInfo.nSquares, instanceInfo.symmetryGroup(options.symmetry), options.ttSizeMb);
+        IncumbentWindow incumbent(options.boundWindow);
+        size_t lastUpperBound = 0;
+
+        // time between handing a result to the master and getting the next task
+        double handoffStart = -1, handoffSeconds = 0;
+        int nHandoffs = 0;
 
         // keep receiving and solving subtasks as long as there are some
         while (true) {
 
             // check whether end or not - if all work is done, the master will send a command to end
             bool endFlag = false;
-            // there might be multiple solution-update messages so iterate over all of them to rid of them
+            // there might be multiple solution-update and work-request messages so iterate over all of them to rid of them
             while (true) {
                 MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
                 if (status.MPI_TAG == TAG::END) {
@@ -80,6 +103,12 @@ int main(int argc, char* argv[]) {
                 } else if (status.MPI_TAG == TAG::SOLUTION_SIZE_UPDATE) {
                     vector<int> dummy(1);
                     MPI_Recv(dummy.data(), 1, MPI_INT, 0, TAG::SOLUTION_SIZE_UPDATE, MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+                } else if (status.MPI_TAG == TAG::STOP) {
+                    // the task was already finished when the master stopped it
+                    MPI_Recv(nullptr, 0, MPI_INT, 0, TAG::STOP, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                } else if (status.MPI_TAG == TAG::WORK_REQUEST) {
+                    // the request was sent before the master learned this slave is done
+                    SolverSlave::refuseWorkRequest();
                 } else
                     break; // no message with the tags above is present - continue
             }
@@ -87,22 +116,41 @@ int main(int argc, char* argv[]) {
             if (endFlag) break;
 
             // get a board state to be worked on
-            MPI_Recv(message.data(), bufferSize, MPI_INT, 0, TAG::BOARD_STATE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            BoardState boardState = BoardState::deserialize(message);
+            // in the delta mode the task is just the moves from the initial state
+            WireReader boardMessage(WireReader::receive(0, TAG::BOARD_STATE));
+            BoardState boardState = options.deltaTasks
+                    ? rootBuilder.build(BoardState::deserializeMoves(boardMessage))
+                    : BoardState::deserialize(boardMessage);
             cout << "\t[SLAVE " << rank << "] board received" << endl;
 
             // get some additional info about state of the solution-finding process
-            MPI_Recv(message.data(), bufferSize, MPI_INT, 0, TAG::BOARD_STATE_OTHERS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            vector<int> message(3);
+            MPI_Recv(message.data(), (int)message.size(), MPI_INT, 0, TAG::BOARD_STATE_OTHERS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
             int bufferIndex = 0;
             size_t initLowerBound = message[bufferIndex++];
             size_t upperBound = message[bufferIndex++];
             int step = message[bufferIndex++];
             cout << "\t[SLAVE " << rank << "] additional info received" << endl;
 
+            if (handoffStart >= 0) {
+                handoffSeconds += MPI_Wtime() - handoffStart;
+                nHandoffs++;
+            }
+
+            // stored positions were pruned with a tighter bound (previous IDA* iteration) - they cannot be trusted now
+            if (upperBound > lastUpperBound)
+                transpositionTable.clear();
+            lastUpperBound = upperBound;
+
             // solve
-            SolverSlave slave(instanceInfo, initLowerBound, upperBound, rank);
+            SolverSlave slave(instanceInfo, options, transpositionTable, incumbent, initLowerBound, upperBound, rank);
             slave.solve(boardState, step);
+            handoffStart = MPI_Wtime();
         }
+
+        if (nHandoffs > 0)
+            cout << "\t[SLAVE " << rank << "] average task handoff latency " << handoffSeconds / nHandoffs * 1000
+                 << " ms (" << nHandoffs << " handoffs)" << endl;
     }
 
     if (rank != 0)
@@ -0,0 +1,46 @@
+#!/bin/bash
+# Thread scaling benchmark of the solver
+#
+# Runs every given input with 1, 2, 4, ... up to the maximal number of OpenMP threads per slave
+# and prints the wall time and the speedup over one thread. Run it with binaries built before and
+# after a change to compare their scaling.
+#
+# Usage: test/scaling.sh <knight_swap binary> [max threads] [slaves] [inputs...] [-- solver options]
+
+BINARY=${1:?Usage: test/scaling.sh <knight_swap binary> [max threads] [slaves] [inputs...] [-- solver options]}
+MAX_THREADS=${2:-$(nproc)}
+SLAVES=${3:-1}
+shift 3 2>/dev/null || shift $#
+
+INPUTS=()
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    INPUTS+=("$1")
+    shift
+done
+[ "$1" == "--" ] && shift
+OPTIONS=("$@")
+
+if [ ${#INPUTS[@]} -eq 0 ]; then
+    INPUTS=("$(dirname "$0")"/inputs/*.txt)
+fi
+
+printf "%-16s %8s %12s %12s %9s\n" "input" "threads" "nodes" "time [ms]" "speedup"
+
+for INPUT in "${INPUTS[@]}"; do
+    BASE=0
+    THREADS=1
+    while [ $THREADS -le $MAX_THREADS ]; do
+        START=$(date +%s%N)
+        OUTPUT=$(OMP_NUM_THREADS=$THREADS mpirun --oversubscribe -np $((SLAVES + 1)) "$BINARY" "${OPTIONS[@]}" "$INPUT" 2>&1)
+        END=$(date +%s%N)
+
+        TIME=$(( (END - START) / 1000000 ))
+        NODES=$(echo "$OUTPUT" | sed -n 's/^Found after \([0-9]*\) iterations$/\1/p')
+        [ $BASE -eq 0 ] && BASE=$TIME
+
+        printf "%-16s %8d %12s %12d %9s\n" "$(basename "$INPUT")" $THREADS "$NODES" $TIME \
+            "$(awk -v b=$BASE -v t=$TIME 'BEGIN { printf "%.2f", (t > 0 ? b / t : 0) }')"
+
+        THREADS=$((THREADS * 2))
+    done
+done